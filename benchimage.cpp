@@ -0,0 +1,16 @@
+#include "benchimage.h"
+#include <QRandomGenerator>
+
+QImage BenchImage::gradientNoise(const QSize& size) {
+    QImage image(size, QImage::Format_RGB32);
+    QRandomGenerator random(42);
+    for (int y = 0; y < size.height(); ++y) {
+        QRgb* line = reinterpret_cast<QRgb*>(image.scanLine(y));
+        for (int x = 0; x < size.width(); ++x) {
+            const int noise = int(random.bounded(32));
+            line[x] = qRgb((x * 255 / size.width() + noise) & 0xff, (y * 255 / size.height() + noise) & 0xff,
+                           ((x + y) * 255 / (size.width() + size.height()) + noise) & 0xff);
+        }
+    }
+    return image;
+}
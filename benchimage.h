@@ -0,0 +1,15 @@
+#ifndef BENCHIMAGE_H
+#define BENCHIMAGE_H
+
+#include <QImage>
+#include <QSize>
+
+// Synthetic input shared by the benchmarks, deterministic for a given size.
+class BenchImage {
+public:
+    // Gradient plus noise: smooth enough to look like a photo, noisy enough
+    // that neither the blur nor the entropy coder benefit from flat regions.
+    static QImage gradientNoise(const QSize& size);
+};
+
+#endif // BENCHIMAGE_H
@@ -0,0 +1,114 @@
+#include <QCoreApplication>
+#include <QColor>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QImage>
+#include <QTextStream>
+#include <QThread>
+#include "benchimage.h"
+#include "boxblur.h"
+
+// Times the scan-emulation blur on synthetic images. "legacy" is the
+// pixelColor/setPixelColor loop BoxBlur replaced; it is slow enough that it
+// only runs up to --legacy-max-mp megapixels. Outputs are compared so the
+// table also shows that both produce identical images.
+
+static QImage legacyBlur(const QImage& image, int radius) {
+    if (radius <= 0 || image.isNull()) {
+        return image;
+    }
+
+    QImage result = QImage(image.size(), image.format());
+    int step = qMax(1, radius / 2);
+
+    for (int y = 0; y < result.height(); y += step) {
+        for (int x = 0; x < result.width(); x += step) {
+            int r = 0, g = 0, b = 0, count = 0;
+
+            int yStart = qMax(0, y - radius);
+            int yEnd = qMin(result.height() - 1, y + radius);
+            int xStart = qMax(0, x - radius);
+            int xEnd = qMin(result.width() - 1, x + radius);
+
+            for (int py = yStart; py <= yEnd; py++) {
+                for (int px = xStart; px <= xEnd; px++) {
+                    QColor c = image.pixelColor(px, py);
+                    r += c.red();
+                    g += c.green();
+                    b += c.blue();
+                    count++;
+                }
+            }
+
+            if (count > 0) {
+                QColor avgColor(r / count, g / count, b / count);
+                for (int py = y; py < qMin(result.height(), y + step); py++) {
+                    for (int px = x; px < qMin(result.width(), x + step); px++) {
+                        result.setPixelColor(px, py, avgColor);
+                    }
+                }
+            }
+        }
+    }
+    return result;
+}
+
+template <typename Blur>
+static double bestMs(int iterations, Blur blur, QImage& output) {
+    double best = -1;
+    for (int i = 0; i < iterations; ++i) {
+        QElapsedTimer timer;
+        timer.start();
+        output = blur();
+        const double ms = timer.nsecsElapsed() / 1e6;
+        if (best < 0 || ms < best) {
+            best = ms;
+        }
+    }
+    return best;
+}
+
+int main(int argc, char* argv[]) {
+    QCoreApplication app(argc, argv);
+    QCommandLineParser cli;
+    cli.setApplicationDescription("Scan emulation blur microbenchmark");
+    cli.addHelpOption();
+    QCommandLineOption iterationsOpt({"n", "iterations"}, "Runs per scenario; the best time is reported.", "count", "3");
+    QCommandLineOption legacyOpt("legacy-max-mp", "Largest image (megapixels) the legacy blur is timed on.", "mp", "2.1");
+    cli.addOption(iterationsOpt);
+    cli.addOption(legacyOpt);
+    cli.process(app);
+    const int iterations = qMax(1, cli.value(iterationsOpt).toInt());
+    const double legacyMaxPixels = cli.value(legacyOpt).toDouble() * 1e6;
+    const int threads = QThread::idealThreadCount();
+
+    QTextStream out(stdout);
+    out << "size         radius   legacy ms   1 thread ms   " << threads << " threads ms   speedup   match\n";
+    const QSize sizes[] = { QSize(640, 480), QSize(1920, 1080), QSize(4000, 3000), QSize(6000, 4000) };
+    for (const QSize& size : sizes) {
+        const QImage image = BenchImage::gradientNoise(size);
+        const bool runLegacy = double(size.width()) * size.height() <= legacyMaxPixels;
+        for (int radius : { 2, 4, 6, 8 }) {
+            QImage single, parallel, legacy;
+            const double singleMs = bestMs(iterations, [&] { return BoxBlur::blockBlur(image, radius, 1); }, single);
+            const double parallelMs = bestMs(iterations, [&] { return BoxBlur::blockBlur(image, radius); }, parallel);
+            double legacyMs = 0;
+            if (runLegacy) {
+                legacyMs = bestMs(1, [&] { return legacyBlur(image, radius); }, legacy);
+            }
+
+            const QString sizeName = QString("%1x%2").arg(size.width()).arg(size.height());
+            const bool match = single == parallel && (!runLegacy || legacy == single);
+            out << QString("%1 %2 %3 %4 %5 %6 %7\n")
+                   .arg(sizeName, -12)
+                   .arg(radius, 6)
+                   .arg(runLegacy ? QString::number(legacyMs, 'f', 1) : QString("-"), 11)
+                   .arg(singleMs, 13, 'f', 2)
+                   .arg(parallelMs, 14, 'f', 2)
+                   .arg(runLegacy ? QString::number(legacyMs / qMax(0.001, parallelMs), 'f', 0) + "x" : QString("-"), 9)
+                   .arg(match ? "yes" : "NO", 7);
+            out.flush();
+        }
+    }
+    return 0;
+}
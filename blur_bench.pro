@@ -0,0 +1,15 @@
+QT = core gui concurrent
+
+CONFIG += c++17 console
+
+TARGET = blur_bench
+TEMPLATE = app
+
+SOURCES += \
+    blur_bench.cpp \
+    benchimage.cpp \
+    boxblur.cpp
+
+HEADERS += \
+    benchimage.h \
+    boxblur.h
@@ -0,0 +1,177 @@
+#include "boxblur.h"
+#include <QList>
+#include <QThread>
+#include <QVector>
+#include <QtConcurrent/QtConcurrent>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Below this many pixels a band is not worth a thread pool round trip.
+const qint64 MinPixelsPerBand = 256 * 1024;
+
+// sums[i] += row[i] (or -=) for the bytes of one scan line, i.e. one
+// column sum per colour channel.
+template <bool Add>
+void accumulateRow(const uchar* row, quint32* sums, int bytes) {
+    int i = 0;
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= bytes; i += 16) {
+        const __m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i));
+        const __m128i lo = _mm_unpacklo_epi8(px, zero);
+        const __m128i hi = _mm_unpackhi_epi8(px, zero);
+        const __m128i parts[4] = {
+            _mm_unpacklo_epi16(lo, zero), _mm_unpackhi_epi16(lo, zero),
+            _mm_unpacklo_epi16(hi, zero), _mm_unpackhi_epi16(hi, zero)
+        };
+        __m128i* s = reinterpret_cast<__m128i*>(sums + i);
+        for (int k = 0; k < 4; ++k) {
+            const __m128i current = _mm_loadu_si128(s + k);
+            _mm_storeu_si128(s + k, Add ? _mm_add_epi32(current, parts[k]) : _mm_sub_epi32(current, parts[k]));
+        }
+    }
+#endif
+    for (; i < bytes; ++i) {
+        if (Add) {
+            sums[i] += row[i];
+        } else {
+            sums[i] -= row[i];
+        }
+    }
+}
+
+struct BlurJob {
+    const QImage* source;
+    // Raw destination, so bands never call the detaching QImage::scanLine().
+    uchar* destination;
+    qsizetype destinationStride;
+    int radius;
+    int step;
+};
+
+// Blurs block rows [firstBlock, lastBlock) of the image.
+void blurBand(const BlurJob& job, int firstBlock, int lastBlock) {
+    const QImage& src = *job.source;
+    const int width = src.width();
+    const int height = src.height();
+    const int bytes = width * 4;
+    const int radius = job.radius;
+    const int step = job.step;
+
+    QVector<quint32> columnSums(bytes, 0);
+    QVector<quint32> line(width);
+    int windowStart = 0;
+    int windowEnd = -1;
+
+    for (int block = firstBlock; block < lastBlock; ++block) {
+        const int y = block * step;
+        const int yStart = qMax(0, y - radius);
+        const int yEnd = qMin(height - 1, y + radius);
+
+        // Slide the vertical window; the first block row of a band fills it.
+        for (int row = windowStart; row < qMin(yStart, windowEnd + 1); ++row) {
+            accumulateRow<false>(src.constScanLine(row), columnSums.data(), bytes);
+        }
+        for (int row = qMax(yStart, windowEnd + 1); row <= yEnd; ++row) {
+            accumulateRow<true>(src.constScanLine(row), columnSums.data(), bytes);
+        }
+        windowStart = yStart;
+        windowEnd = yEnd;
+
+        // Slide the horizontal window over the column sums the same way.
+        const quint32* sums = columnSums.constData();
+        const int rows = yEnd - yStart + 1;
+        quint64 total[4] = { 0, 0, 0, 0 };
+        int xFrom = 0;
+        int xTo = -1;
+        for (int x = 0; x < width; x += step) {
+            const int xStart = qMax(0, x - radius);
+            const int xEnd = qMin(width - 1, x + radius);
+            for (int col = xFrom; col < qMin(xStart, xTo + 1); ++col) {
+                for (int c = 0; c < 4; ++c) {
+                    total[c] -= sums[col * 4 + c];
+                }
+            }
+            for (int col = qMax(xStart, xTo + 1); col <= xEnd; ++col) {
+                for (int c = 0; c < 4; ++c) {
+                    total[c] += sums[col * 4 + c];
+                }
+            }
+            xFrom = xStart;
+            xTo = xEnd;
+
+            // Channels are averaged in memory order, so the pixel layout
+            // does not matter; alpha is forced opaque like QColor(r, g, b).
+            const quint64 count = quint64(rows) * quint64(xEnd - xStart + 1);
+            uchar mean[4];
+            for (int c = 0; c < 4; ++c) {
+                mean[c] = uchar(total[c] / count);
+            }
+            quint32 pixel;
+            std::memcpy(&pixel, mean, sizeof(pixel));
+            pixel |= 0xff000000u;
+
+            const int blockEnd = qMin(width, x + step);
+            for (int px = x; px < blockEnd; ++px) {
+                line[px] = pixel;
+            }
+        }
+
+        const int rowEnd = qMin(height, y + step);
+        for (int row = y; row < rowEnd; ++row) {
+            std::memcpy(job.destination + row * job.destinationStride, line.constData(), bytes);
+        }
+    }
+}
+
+}
+
+QImage BoxBlur::blockBlur(const QImage& image, int radius, int threads) {
+    if (radius <= 0 || image.isNull()) {
+        return image;
+    }
+
+    QImage source = image;
+    if (source.format() != QImage::Format_RGB32 && source.format() != QImage::Format_ARGB32) {
+        source = source.convertToFormat(QImage::Format_RGB32);
+    }
+    QImage result(source.size(), source.format());
+    if (result.isNull()) {
+        return result;
+    }
+
+    BlurJob job;
+    job.source = &source;
+    job.destination = result.bits();
+    job.destinationStride = result.bytesPerLine();
+    job.radius = radius;
+    job.step = qMax(1, radius / 2);
+
+    const int blockRows = (source.height() + job.step - 1) / job.step;
+    if (threads <= 0) {
+        threads = QThread::idealThreadCount();
+    }
+    const qint64 pixels = qint64(source.width()) * source.height();
+    const int bands = int(qBound<qint64>(1, qMin<qint64>(threads, pixels / MinPixelsPerBand), blockRows));
+
+    if (bands == 1) {
+        blurBand(job, 0, blockRows);
+        return result;
+    }
+
+    // Bands write disjoint scan lines; each re-primes its own window, which
+    // costs at most 2 * radius extra rows per band.
+    QList<int> bandIndexes;
+    for (int band = 0; band < bands; ++band) {
+        bandIndexes << band;
+    }
+    QtConcurrent::blockingMap(bandIndexes, [&job, blockRows, bands](int band) {
+        blurBand(job, int(qint64(blockRows) * band / bands), int(qint64(blockRows) * (band + 1) / bands));
+    });
+    return result;
+}
@@ -0,0 +1,21 @@
+#ifndef BOXBLUR_H
+#define BOXBLUR_H
+
+#include <QImage>
+
+// Block blur used to emulate progressive scans. Every step x step block
+// (step = radius / 2, at least 1) is filled with the mean colour of the
+// (2 * radius + 1)^2 window around its top-left pixel, clipped to the image.
+//
+// Works directly on scanLine() memory: column sums slide down the image and
+// window sums slide across each block row, so the cost no longer depends on
+// the radius. Large images are split into bands of block rows that run on
+// the global thread pool.
+class BoxBlur {
+public:
+    // threads <= 0 uses QThread::idealThreadCount(). The result is RGB32,
+    // or ARGB32 (fully opaque) if the input was ARGB32.
+    static QImage blockBlur(const QImage& image, int radius, int threads = 0);
+};
+
+#endif // BOXBLUR_H
@@ -0,0 +1,130 @@
+#include "filesender.h"
+#include <QSocketNotifier>
+#include <QDebug>
+
+#ifdef Q_OS_LINUX
+#include <sys/sendfile.h>
+#include <errno.h>
+#endif
+
+FileSender::FileSender(QTcpSocket* socket, const QString& path, qint64 offset, qint64 length,
+                       QObject* parent)
+    : QObject(parent), socket(socket), file(path), offset(offset), length(length),
+      sent(0), mapped(nullptr), writeNotifier(nullptr), done(false) {
+    connect(socket, &QTcpSocket::bytesWritten, this, &FileSender::onBytesWritten);
+    connect(socket, &QTcpSocket::disconnected, this, [this]() {
+        finish(false);
+    });
+}
+
+FileSender::~FileSender() {
+    if (mapped) {
+        file.unmap(mapped);
+    }
+}
+
+void FileSender::start() {
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "FileSender: cannot open" << file.fileName() << file.errorString();
+        finish(false);
+        return;
+    }
+    if (length < 0) {
+        length = file.size() - offset;
+    }
+    if (offset < 0 || length < 0 || offset + length > file.size()) {
+        qWarning() << "FileSender: range out of bounds for" << file.fileName();
+        finish(false);
+        return;
+    }
+#ifndef Q_OS_LINUX
+    if (length > 0) {
+        mapped = file.map(offset, length);
+        if (!mapped) {
+            qWarning() << "FileSender: cannot map" << file.fileName() << file.errorString();
+            finish(false);
+            return;
+        }
+    }
+#endif
+    pump();
+}
+
+qint64 FileSender::bytesSentDirectly() const {
+#ifdef Q_OS_LINUX
+    return sent;
+#else
+    return 0;
+#endif
+}
+
+void FileSender::onBytesWritten() {
+    pump();
+}
+
+void FileSender::onWritable() {
+    writeNotifier->setEnabled(false);
+    pump();
+}
+
+void FileSender::pump() {
+    if (done) {
+        return;
+    }
+    // Headers (or the previous mapped chunk) must leave Qt's buffer first,
+    // otherwise the file bytes would overtake them on the wire.
+    if (socket->bytesToWrite() > 0) {
+        return;
+    }
+    if (sent >= length) {
+        finish(true);
+        return;
+    }
+
+#ifdef Q_OS_LINUX
+    const int fd = int(socket->socketDescriptor());
+    while (sent < length) {
+        off_t pos = off_t(offset + sent);
+        ssize_t n = ::sendfile(fd, file.handle(), &pos, size_t(qMin(ChunkSize, length - sent)));
+        if (n > 0) {
+            sent += n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (!writeNotifier) {
+                writeNotifier = new QSocketNotifier(socket->socketDescriptor(), QSocketNotifier::Write, this);
+                connect(writeNotifier, &QSocketNotifier::activated, this, &FileSender::onWritable);
+            }
+            writeNotifier->setEnabled(true);
+            return;
+        }
+        qWarning() << "FileSender: sendfile failed:" << (n == 0 ? QString("file truncated") : qt_error_string(errno));
+        finish(false);
+        return;
+    }
+    finish(true);
+#else
+    const qint64 chunk = qMin(ChunkSize, length - sent);
+    const qint64 written = socket->write(reinterpret_cast<const char*>(mapped) + sent, chunk);
+    if (written < 0) {
+        qWarning() << "FileSender: write failed:" << socket->errorString();
+        finish(false);
+        return;
+    }
+    sent += written;
+#endif
+}
+
+void FileSender::finish(bool success) {
+    if (done) {
+        return;
+    }
+    done = true;
+    if (writeNotifier) {
+        writeNotifier->setEnabled(false);
+    }
+    emit finished(success);
+}
@@ -0,0 +1,49 @@
+#ifndef FILESENDER_H
+#define FILESENDER_H
+
+#include <QObject>
+#include <QFile>
+#include <QtNetwork/QTcpSocket>
+
+class QSocketNotifier;
+
+// Streams a byte range of a file to a plain TCP socket without building a
+// QByteArray of it: sendfile(2) on Linux, a QFile::map() region elsewhere.
+// Anything already queued on the socket is flushed first.
+class FileSender : public QObject {
+    Q_OBJECT
+public:
+    FileSender(QTcpSocket* socket, const QString& path, qint64 offset, qint64 length,
+               QObject* parent = nullptr);
+    ~FileSender();
+
+    void start();
+    qint64 bytesSent() const { return sent; }
+    // Bytes that went around the socket (sendfile) and so never show up in
+    // its bytesWritten signal.
+    qint64 bytesSentDirectly() const;
+
+signals:
+    void finished(bool success);
+
+private slots:
+    void onBytesWritten();
+    void onWritable();
+
+private:
+    void pump();
+    void finish(bool success);
+
+    QTcpSocket* socket;
+    QFile file;
+    qint64 offset;
+    qint64 length;
+    qint64 sent;
+    uchar* mapped;
+    QSocketNotifier* writeNotifier;
+    bool done;
+
+    static const qint64 ChunkSize = 256 * 1024;
+};
+
+#endif // FILESENDER_H
@@ -0,0 +1,344 @@
+#include "httpparser.h"
+#include <cstring>
+
+namespace {
+
+inline bool isSpace(char c) {
+    return c == ' ' || c == '\t';
+}
+
+QByteArrayView trimmed(QByteArrayView value) {
+    qsizetype b = 0;
+    qsizetype e = value.size();
+    while (b < e && isSpace(value[b])) {
+        ++b;
+    }
+    while (e > b && isSpace(value[e - 1])) {
+        --e;
+    }
+    return value.sliced(b, e - b);
+}
+
+// Non-negative decimal; false if empty, not all digits or too long.
+bool parseNumber(QByteArrayView value, qint64& number) {
+    if (value.isEmpty() || value.size() > 18) {
+        return false;
+    }
+    number = 0;
+    for (char c : value) {
+        if (c < '0' || c > '9') {
+            return false;
+        }
+        number = number * 10 + (c - '0');
+    }
+    return true;
+}
+
+}
+
+HttpParser::HttpParser(Mode mode, qsizetype maxHeaderSize)
+    : mode(mode), maxHeaderSize(maxHeaderSize) {
+    reset();
+}
+
+void HttpParser::reset() {
+    state = mode == Fields ? HeaderFields : StartLine;
+    base = nullptr;
+    scanned = 0;
+    searched = 0;
+    headerEnd = 0;
+    methodField = Span();
+    targetField = Span();
+    versionField = Span();
+    reasonField = Span();
+    code = 0;
+    length = -1;
+    fields.clear();
+    error.clear();
+    oversized = false;
+}
+
+HttpParser::Status HttpParser::parse(const QByteArray& buffer) {
+    return parse(buffer.constData(), buffer.size());
+}
+
+HttpParser::Status HttpParser::parse(const char* data, qsizetype size) {
+    base = data;
+    if (state == Finished) {
+        return Done;
+    }
+    if (state == Failed) {
+        return Error;
+    }
+
+    while (true) {
+        // Bytes in [scanned, searched) are known to hold no line break.
+        const qsizetype from = qMax(scanned, searched);
+        const void* newline = from < size ? std::memchr(data + from, '\n', size_t(size - from)) : nullptr;
+        if (!newline) {
+            searched = size;
+            if (size > maxHeaderSize) {
+                oversized = true;
+                return fail("header too large");
+            }
+            return NeedMore;
+        }
+
+        const qsizetype lineBegin = scanned;
+        const qsizetype lineEnd = static_cast<const char*>(newline) - data;
+        qsizetype contentEnd = lineEnd;
+        if (contentEnd > lineBegin && data[contentEnd - 1] == '\r') {
+            --contentEnd;
+        }
+        scanned = lineEnd + 1;
+        searched = scanned;
+        if (scanned > maxHeaderSize) {
+            oversized = true;
+            return fail("header too large");
+        }
+
+        if (state == StartLine) {
+            // A stray CRLF before the start line is tolerated (RFC 9112, 2.2).
+            if (contentEnd == lineBegin) {
+                continue;
+            }
+            if (!parseStartLine(lineBegin, contentEnd)) {
+                return fail("malformed start line");
+            }
+            state = HeaderFields;
+            continue;
+        }
+
+        if (contentEnd == lineBegin) {
+            headerEnd = scanned;
+            state = Finished;
+            return Done;
+        }
+        if (!parseField(lineBegin, contentEnd)) {
+            return fail("malformed header field");
+        }
+    }
+}
+
+bool HttpParser::parseStartLine(qsizetype begin, qsizetype end) {
+    const char* line = base + begin;
+    const qsizetype size = end - begin;
+    const void* firstSpace = std::memchr(line, ' ', size_t(size));
+    if (!firstSpace) {
+        return false;
+    }
+    const qsizetype first = static_cast<const char*>(firstSpace) - line;
+
+    if (mode == Request) {
+        qsizetype last = size - 1;
+        while (last > first && line[last] != ' ') {
+            --last;
+        }
+        if (first == 0 || last == first || last + 1 >= size) {
+            return false;
+        }
+        methodField = { begin, first };
+        targetField = { begin + first + 1, last - first - 1 };
+        versionField = { begin + last + 1, size - last - 1 };
+        return targetField.size > 0 && view(versionField).startsWith("HTTP/");
+    }
+
+    versionField = { begin, first };
+    if (!view(versionField).startsWith("HTTP/") || first + 4 > size) {
+        return false;
+    }
+    code = 0;
+    for (qsizetype i = first + 1; i < first + 4; ++i) {
+        if (line[i] < '0' || line[i] > '9') {
+            return false;
+        }
+        code = code * 10 + (line[i] - '0');
+    }
+    const qsizetype reasonBegin = qMin(size, first + 5);
+    reasonField = { begin + reasonBegin, size - reasonBegin };
+    return true;
+}
+
+bool HttpParser::parseField(qsizetype begin, qsizetype end) {
+    const char* line = base + begin;
+    const qsizetype size = end - begin;
+    // Obsolete line folding is rejected rather than unfolded.
+    if (isSpace(line[0])) {
+        return false;
+    }
+    const void* colon = std::memchr(line, ':', size_t(size));
+    if (!colon) {
+        return false;
+    }
+    const qsizetype nameSize = static_cast<const char*>(colon) - line;
+    if (nameSize == 0 || isSpace(line[nameSize - 1])) {
+        return false;
+    }
+
+    qsizetype valueBegin = nameSize + 1;
+    qsizetype valueEnd = size;
+    while (valueBegin < valueEnd && isSpace(line[valueBegin])) {
+        ++valueBegin;
+    }
+    while (valueEnd > valueBegin && isSpace(line[valueEnd - 1])) {
+        --valueEnd;
+    }
+
+    Field field;
+    field.name = { begin, nameSize };
+    field.value = { begin + valueBegin, valueEnd - valueBegin };
+    fields.append(field);
+
+    if (equalsIgnoreCase(view(field.name), "Content-Length")) {
+        qint64 parsed = 0;
+        if (!parseNumber(view(field.value), parsed)) {
+            return false;
+        }
+        if (length >= 0 && length != parsed) {
+            return false;
+        }
+        length = parsed;
+    }
+    return true;
+}
+
+HttpParser::Status HttpParser::fail(const char* reason) {
+    state = Failed;
+    error = reason;
+    return Error;
+}
+
+QByteArrayView HttpParser::header(QByteArrayView name) const {
+    for (const Field& field : fields) {
+        if (equalsIgnoreCase(view(field.name), name)) {
+            return view(field.value);
+        }
+    }
+    return QByteArrayView();
+}
+
+bool HttpParser::hasHeader(QByteArrayView name) const {
+    for (const Field& field : fields) {
+        if (equalsIgnoreCase(view(field.name), name)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool HttpParser::keepAlive() const {
+    const QByteArrayView connection = header("Connection");
+    if (isHttp10()) {
+        return containsToken(connection, "keep-alive");
+    }
+    return !containsToken(connection, "close");
+}
+
+HttpParser::RangeResult HttpParser::parseRange(QByteArrayView value, qint64 size, qint64& first, qint64& last) {
+    value = trimmed(value);
+    if (value.size() < 6 || !equalsIgnoreCase(value.first(6), "bytes=") || value.contains(',')) {
+        return NoRange;
+    }
+    const QByteArrayView spec = trimmed(value.sliced(6));
+    const qsizetype dash = spec.indexOf('-');
+    if (dash < 0) {
+        return NoRange;
+    }
+    const QByteArrayView from = trimmed(spec.first(dash));
+    const QByteArrayView to = trimmed(spec.sliced(dash + 1));
+
+    if (from.isEmpty()) {
+        // Suffix range: the last N bytes.
+        qint64 suffix = 0;
+        if (!parseNumber(to, suffix)) {
+            return NoRange;
+        }
+        if (suffix == 0 || size == 0) {
+            return RangeNotSatisfiable;
+        }
+        first = qMax<qint64>(0, size - suffix);
+        last = size - 1;
+        return RangeSatisfiable;
+    }
+
+    qint64 begin = 0;
+    qint64 end = 0;
+    if (!parseNumber(from, begin) || (!to.isEmpty() && (!parseNumber(to, end) || end < begin))) {
+        return NoRange;
+    }
+    if (to.isEmpty()) {
+        end = size - 1;
+    }
+    if (begin >= size) {
+        return RangeNotSatisfiable;
+    }
+    first = begin;
+    last = qMin(end, size - 1);
+    return RangeSatisfiable;
+}
+
+bool HttpParser::parseContentRange(QByteArrayView value, qint64& first, qint64& last, qint64& total) {
+    value = trimmed(value);
+    if (value.size() < 6 || !equalsIgnoreCase(value.first(6), "bytes ")) {
+        return false;
+    }
+    const QByteArrayView spec = trimmed(value.sliced(6));
+    const qsizetype dash = spec.indexOf('-');
+    const qsizetype slash = spec.indexOf('/');
+    if (dash < 0 || slash < dash) {
+        return false;
+    }
+    if (!parseNumber(spec.first(dash), first)
+            || !parseNumber(spec.sliced(dash + 1, slash - dash - 1), last) || last < first) {
+        return false;
+    }
+    const QByteArrayView length = spec.sliced(slash + 1);
+    if (length == QByteArrayView("*")) {
+        total = -1;
+        return true;
+    }
+    return parseNumber(length, total) && last < total;
+}
+
+QByteArray HttpParser::parameter(QByteArrayView value, QByteArrayView name) {
+    qsizetype pos = value.indexOf(';');
+    while (pos >= 0) {
+        qsizetype next = pos + 1;
+        while (next < value.size() && value[next] != ';') {
+            ++next;
+        }
+        const QByteArrayView item = trimmed(value.sliced(pos + 1, next - pos - 1));
+        const qsizetype equals = item.indexOf('=');
+        if (equals > 0 && equalsIgnoreCase(trimmed(item.first(equals)), name)) {
+            QByteArrayView result = trimmed(item.sliced(equals + 1));
+            if (result.size() >= 2 && result[0] == '"' && result[result.size() - 1] == '"') {
+                result = result.sliced(1, result.size() - 2);
+            }
+            return result.toByteArray();
+        }
+        pos = next < value.size() ? next : -1;
+    }
+    return QByteArray();
+}
+
+bool HttpParser::containsToken(QByteArrayView value, QByteArrayView token) {
+    qsizetype pos = 0;
+    while (pos < value.size()) {
+        qsizetype next = pos;
+        while (next < value.size() && value[next] != ',') {
+            ++next;
+        }
+        if (equalsIgnoreCase(trimmed(value.sliced(pos, next - pos)), token)) {
+            return true;
+        }
+        pos = next + 1;
+    }
+    return false;
+}
+
+bool HttpParser::equalsIgnoreCase(QByteArrayView a, QByteArrayView b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    return a.isEmpty() || qstrnicmp(a.data(), b.data(), size_t(a.size())) == 0;
+}
@@ -0,0 +1,104 @@
+#ifndef HTTPPARSER_H
+#define HTTPPARSER_H
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QVarLengthArray>
+#include <QtGlobal>
+
+// Resumable HTTP/1.x header parser shared by the servers and the clients.
+//
+// parse() is called with the whole receive buffer every time more bytes
+// arrive; it only looks at bytes it has not seen yet, so feeding a header
+// in many small pieces stays linear. Header names and values are returned
+// as views into that buffer: they are valid until the buffer is modified,
+// so copy what you need before consuming headerSize() bytes from it.
+class HttpParser {
+public:
+    // Fields parses a bare header block, e.g. the headers of a multipart part.
+    enum Mode { Request, Response, Fields };
+    enum Status { NeedMore, Done, Error };
+    enum RangeResult { NoRange, RangeSatisfiable, RangeNotSatisfiable };
+
+    explicit HttpParser(Mode mode, qsizetype maxHeaderSize = 64 * 1024);
+
+    void reset();
+    Status parse(const QByteArray& buffer);
+    Status parse(const char* data, qsizetype size);
+
+    Status status() const { return state == Finished ? Done : (state == Failed ? Error : NeedMore); }
+    // Bytes occupied by the request/status line, the fields and the blank line.
+    qsizetype headerSize() const { return headerEnd; }
+    QByteArray errorString() const { return error; }
+    bool headerTooLarge() const { return oversized; }
+
+    // Request line (Request mode).
+    QByteArrayView method() const { return view(methodField); }
+    QByteArrayView target() const { return view(targetField); }
+    // Status line (Response mode).
+    int statusCode() const { return code; }
+    QByteArrayView reason() const { return view(reasonField); }
+
+    QByteArrayView version() const { return view(versionField); }
+    bool isHttp10() const { return version() == QByteArrayView("HTTP/1.0"); }
+
+    int headerCount() const { return int(fields.size()); }
+    QByteArrayView headerName(int index) const { return view(fields[index].name); }
+    QByteArrayView headerValue(int index) const { return view(fields[index].value); }
+    // Case-insensitive lookup; empty view when the header is absent.
+    QByteArrayView header(QByteArrayView name) const;
+    bool hasHeader(QByteArrayView name) const;
+
+    // -1 when absent; Error status when present but malformed.
+    qint64 contentLength() const { return length; }
+    bool keepAlive() const;
+
+    // Single "bytes=" range against a representation of the given size.
+    // Malformed values and multi-range requests yield NoRange, so the
+    // whole representation is sent instead.
+    static RangeResult parseRange(QByteArrayView value, qint64 size, qint64& first, qint64& last);
+    // "bytes first-last/total"; total is -1 when the server sent "*".
+    static bool parseContentRange(QByteArrayView value, qint64& first, qint64& last, qint64& total);
+
+    // Value of a ";name=value" parameter, e.g. the boundary of a Content-Type.
+    static QByteArray parameter(QByteArrayView value, QByteArrayView name);
+    static bool containsToken(QByteArrayView value, QByteArrayView token);
+    static bool equalsIgnoreCase(QByteArrayView a, QByteArrayView b);
+
+private:
+    enum State { StartLine, HeaderFields, Finished, Failed };
+    struct Span {
+        qsizetype offset = 0;
+        qsizetype size = 0;
+    };
+    struct Field {
+        Span name;
+        Span value;
+    };
+
+    QByteArrayView view(const Span& span) const {
+        return base ? QByteArrayView(base + span.offset, span.size) : QByteArrayView();
+    }
+    bool parseStartLine(qsizetype begin, qsizetype end);
+    bool parseField(qsizetype begin, qsizetype end);
+    Status fail(const char* reason);
+
+    Mode mode;
+    qsizetype maxHeaderSize;
+    State state;
+    const char* base;
+    qsizetype scanned;
+    qsizetype searched;
+    qsizetype headerEnd;
+    Span methodField;
+    Span targetField;
+    Span versionField;
+    Span reasonField;
+    int code;
+    qint64 length;
+    QVarLengthArray<Field, 16> fields;
+    QByteArray error;
+    bool oversized;
+};
+
+#endif // HTTPPARSER_H
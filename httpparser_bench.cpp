@@ -0,0 +1,115 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QList>
+#include <QTextStream>
+#include "httpparser.h"
+
+// Parses the same header many times, either in one piece or fed in fixed
+// increments the way readyRead delivers it, and reports bytes/sec. The
+// "legacy" variant is the indexOf/split/toLower code the parser replaced.
+
+static QByteArray sampleRequest() {
+    return "GET /photos/2024/holiday/IMG_0042.jpg?w=320&h=240&q=60 HTTP/1.1\r\n"
+           "Host: 192.168.1.20:12345\r\n"
+           "User-Agent: jpeg_viewer/1.0\r\n"
+           "Accept: image/jpeg, */*;q=0.8\r\n"
+           "Accept-Encoding: identity\r\n"
+           "Range: bytes=1048576-\r\n"
+           "If-Range: \"5f3a-1a2b3c\"\r\n"
+           "Connection: keep-alive\r\n"
+           "\r\n";
+}
+
+static QByteArray sampleResponse() {
+    return "HTTP/1.1 200 OK\r\n"
+           "Content-Type: image/jpeg\r\n"
+           "Content-Length: 4718592\r\n"
+           "Accept-Ranges: bytes\r\n"
+           "ETag: \"5f3a-1a2b3c\"\r\n"
+           "Connection: keep-alive\r\n"
+           "Keep-Alive: timeout=5, max=99\r\n"
+           "\r\n";
+}
+
+static volatile qint64 benchmarkSink = 0;
+
+static qint64 legacyParse(const QByteArray& accum) {
+    int headerEnd = accum.indexOf("\r\n\r\n");
+    if (headerEnd == -1) {
+        return -2;
+    }
+    QByteArray header = accum.left(headerEnd);
+    qint64 contentLength = -1;
+    QList<QByteArray> lines = header.split('\n');
+    for (const QByteArray& line : lines) {
+        QByteArray trimmedLine = line.trimmed();
+        if (trimmedLine.toLower().startsWith("content-length:")) {
+            contentLength = trimmedLine.mid(15).trimmed().toLongLong();
+        }
+    }
+    return contentLength;
+}
+
+static double run(const QByteArray& message, int step, int iterations, bool legacy, HttpParser::Mode mode) {
+    QByteArray accum;
+    accum.reserve(message.size());
+    HttpParser parser(mode);
+
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < iterations; ++i) {
+        accum.clear();
+        parser.reset();
+        for (int pos = 0; pos < message.size(); pos += step) {
+            accum.append(message.constData() + pos, qMin(step, int(message.size()) - pos));
+            if (legacy) {
+                const qint64 contentLength = legacyParse(accum);
+                if (contentLength != -2) {
+                    benchmarkSink = contentLength;
+                    break;
+                }
+            } else if (parser.parse(accum) != HttpParser::NeedMore) {
+                benchmarkSink = parser.contentLength() + parser.headerCount();
+                break;
+            }
+        }
+    }
+    const qint64 ns = qMax<qint64>(1, timer.nsecsElapsed());
+    return double(message.size()) * iterations * 1e9 / ns;
+}
+
+int main(int argc, char* argv[]) {
+    QCoreApplication app(argc, argv);
+    QCommandLineParser cli;
+    cli.setApplicationDescription("HTTP header parser microbenchmark");
+    cli.addHelpOption();
+    QCommandLineOption iterationsOpt({"n", "iterations"}, "Messages parsed per scenario.", "count", "200000");
+    cli.addOption(iterationsOpt);
+    cli.process(app);
+    const int iterations = qMax(1, cli.value(iterationsOpt).toInt());
+
+    QTextStream out(stdout);
+    out << "scenario                     step   HttpParser MB/s   legacy MB/s\n";
+    const struct {
+        const char* name;
+        QByteArray message;
+        HttpParser::Mode mode;
+    } samples[] = {
+        { "request", sampleRequest(), HttpParser::Request },
+        { "response", sampleResponse(), HttpParser::Response },
+    };
+    for (const auto& sample : samples) {
+        for (int step : { int(sample.message.size()), 64, 16, 1 }) {
+            const int n = step == 1 ? qMax(1, iterations / 20) : iterations;
+            const double fast = run(sample.message, step, n, false, sample.mode);
+            const double legacy = run(sample.message, step, n, true, sample.mode);
+            out << QString("%1 %2 %3 %4\n")
+                   .arg(QString(sample.name), -24)
+                   .arg(step, 8)
+                   .arg(fast / 1e6, 17, 'f', 1)
+                   .arg(legacy / 1e6, 13, 'f', 1);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,13 @@
+QT = core
+
+CONFIG += c++17 console
+
+TARGET = httpparser_bench
+TEMPLATE = app
+
+SOURCES += \
+    httpparser_bench.cpp \
+    httpparser.cpp
+
+HEADERS += \
+    httpparser.h
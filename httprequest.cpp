@@ -0,0 +1,37 @@
+#include "httprequest.h"
+
+namespace {
+
+QByteArray connectionHeader(bool keepAlive) {
+    return keepAlive ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+}
+
+}
+
+QByteArray HttpRequest::imageGet(const QByteArray& target, const QString& host, bool acceptScans, bool keepAlive,
+                                 qint64 first, qint64 last, const QByteArray& ifRange) {
+    QByteArray header = "GET " + target + " HTTP/1.1\r\n"
+                        "Host: " + host.toUtf8() + "\r\n";
+    header += acceptScans ? "Accept: multipart/x-mixed-replace, image/jpeg\r\n" : "Accept: image/jpeg\r\n";
+    if (first >= 0) {
+        header += "Range: bytes=" + QByteArray::number(first) + '-'
+                + (last >= 0 ? QByteArray::number(last) : QByteArray()) + "\r\n";
+        if (!ifRange.isEmpty()) {
+            header += "If-Range: " + ifRange + "\r\n";
+        }
+    }
+    header += connectionHeader(keepAlive);
+    header += "\r\n";
+    return header;
+}
+
+QByteArray HttpRequest::imageUpload(const QByteArray& target, const QString& host, qint64 contentLength,
+                                    bool keepAlive) {
+    QByteArray header = "POST " + target + " HTTP/1.1\r\n"
+                        "Host: " + host.toUtf8() + "\r\n"
+                        "Content-Type: image/jpeg\r\n"
+                        "Content-Length: " + QByteArray::number(contentLength) + "\r\n";
+    header += connectionHeader(keepAlive);
+    header += "\r\n";
+    return header;
+}
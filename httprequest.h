@@ -0,0 +1,24 @@
+#ifndef HTTPREQUEST_H
+#define HTTPREQUEST_H
+
+#include <QByteArray>
+#include <QString>
+#include <QtGlobal>
+
+// Request headers as the clients frame them, shared by JPEGClient and
+// jpeg_bench so both always send the same requests. Responses are read
+// with HttpParser.
+class HttpRequest {
+public:
+    // GET of an image. With acceptScans a progressive server may answer with
+    // a multipart/x-mixed-replace stream of scans. A byte range is requested
+    // when first >= 0 (open-ended when last < 0), guarded by If-Range when
+    // an entity tag is given.
+    static QByteArray imageGet(const QByteArray& target, const QString& host, bool acceptScans, bool keepAlive,
+                               qint64 first = -1, qint64 last = -1, const QByteArray& ifRange = QByteArray());
+    // POST of a JPEG body of the given length; the body is written after it.
+    static QByteArray imageUpload(const QByteArray& target, const QString& host, qint64 contentLength,
+                                  bool keepAlive);
+};
+
+#endif // HTTPREQUEST_H
@@ -18,7 +18,10 @@ public:
     
     virtual bool loadImage(const QString& filename, QImage& image) = 0;
     virtual bool saveImage(const QString& filename, const QImage& image, 
-                          int quality, bool progressive, int dctMethod) = 0;
+                          int quality, bool progressive, int dctMethod, int subsampling) = 0;
+
+    // See JPEGStrategy::setCancelCheck().
+    void setCancelCheck(const std::function<bool()>& cancelled) { strategy->setCancelCheck(cancelled); }
 
     virtual bool loadNextScan(QImage& image) { Q_UNUSED(image); return false; }
     virtual bool hasMoreScans() const { return false; }
@@ -39,8 +42,8 @@ public:
     }
     
     bool saveImage(const QString& filename, const QImage& image, 
-                  int quality, bool progressive, int dctMethod) override {
-        return strategy->saveImage(filename, image, quality, progressive, dctMethod);
+                  int quality, bool progressive, int dctMethod, int subsampling) override {
+        return strategy->saveImage(filename, image, quality, progressive, dctMethod, subsampling);
     }
 };
 
@@ -54,8 +57,8 @@ public:
     }
     
     bool saveImage(const QString& filename, const QImage& image, 
-                  int quality, bool progressive, int dctMethod) override {
-        return strategy->saveImage(filename, image, quality, progressive, dctMethod);
+                  int quality, bool progressive, int dctMethod, int subsampling) override {
+        return strategy->saveImage(filename, image, quality, progressive, dctMethod, subsampling);
     }
     
     bool loadNextScan(QImage& image) override {
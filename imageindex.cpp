@@ -0,0 +1,269 @@
+#include "imageindex.h"
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <QImageReader>
+#include <QSet>
+#include <QUrl>
+#include <QtConcurrent/QtConcurrent>
+
+namespace {
+
+QStringList listJpegFiles(const QString& dir) {
+    QDir d(dir);
+    const QStringList names = d.entryList({"*.jpg", "*.jpeg"}, QDir::Files | QDir::Readable);
+    QStringList result;
+    result.reserve(names.size());
+    for (const QString& name : names) {
+        result << d.filePath(name);
+    }
+    return result;
+}
+
+ImageIndexEntry readEntry(const QString& filePath) {
+    ImageIndexEntry entry;
+    QFileInfo info(filePath);
+    entry.filePath = info.absoluteFilePath();
+    entry.size = info.size();
+    entry.modified = info.lastModified().toMSecsSinceEpoch();
+    // Header only; files Qt cannot identify as JPEG keep an invalid size.
+    QImageReader reader(filePath, "jpeg");
+    entry.dimensions = reader.size();
+    return entry;
+}
+
+QString parentKey(const QString& key) {
+    return key.section('/', 0, -2);
+}
+
+}
+
+ImageIndex::ImageIndex(QObject* parent)
+    : QObject(parent), watcher(new QFileSystemWatcher(this)) {
+    connect(watcher, &QFileSystemWatcher::directoryChanged, this, &ImageIndex::onDirectoryChanged);
+}
+
+bool ImageIndex::build(const QString& rootPath) {
+    QFileInfo rootInfo(rootPath);
+    if (!rootInfo.isDir()) {
+        qWarning() << "Image index root is not a directory:" << rootPath;
+        return false;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    root = rootInfo.absoluteFilePath();
+
+    QStringList directories{root};
+    QDirIterator it(root, QDir::Dirs | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        directories << it.next();
+    }
+
+    // Listing and header reads dominate on large trees; both run in parallel.
+    const QList<QStringList> listed = QtConcurrent::blockingMapped<QList<QStringList>>(directories, listJpegFiles);
+    QStringList files;
+    for (const QStringList& dirFiles : listed) {
+        files += dirFiles;
+    }
+    const QList<ImageIndexEntry> scanned = QtConcurrent::blockingMapped<QList<ImageIndexEntry>>(files, readEntry);
+
+    QHash<QString, ImageIndexEntry> newEntries;
+    QHash<QString, QStringList> newDirectories;
+    newEntries.reserve(scanned.size());
+    for (const QString& dir : directories) {
+        newDirectories.insert(keyForFile(dir), QStringList());
+    }
+    for (const ImageIndexEntry& entry : scanned) {
+        if (!entry.dimensions.isValid()) {
+            continue;
+        }
+        const QString key = keyForFile(entry.filePath);
+        newEntries.insert(key, entry);
+        newDirectories[parentKey(key)].append(key);
+    }
+
+    {
+        QWriteLocker locker(&lock);
+        entries.swap(newEntries);
+        directoryFiles.swap(newDirectories);
+    }
+
+    if (!watcher->directories().isEmpty()) {
+        watcher->removePaths(watcher->directories());
+    }
+    watcher->addPaths(directories);
+
+    qDebug() << "Indexed" << count() << "images in" << directories.size()
+             << "directories under" << root << "in" << timer.elapsed() << "ms";
+    return true;
+}
+
+int ImageIndex::count() const {
+    QReadLocker locker(&lock);
+    return entries.size();
+}
+
+bool ImageIndex::lookup(const QString& relativePath, ImageIndexEntry& entry) const {
+    QReadLocker locker(&lock);
+    auto it = entries.constFind(relativePath);
+    if (it == entries.constEnd()) {
+        return false;
+    }
+    entry = it.value();
+    return true;
+}
+
+QString ImageIndex::keyForRequestPath(const QByteArray& target) {
+    QByteArray path = target;
+    const int query = path.indexOf('?');
+    if (query >= 0) {
+        path.truncate(query);
+    }
+    const QString decoded = QUrl::fromPercentEncoding(path);
+    if (decoded.contains(QChar(0)) || decoded.contains('\\')) {
+        return QString();
+    }
+
+    QStringList segments;
+    for (const QString& segment : decoded.split('/', Qt::SkipEmptyParts)) {
+        if (segment == "..") {
+            return QString();
+        }
+        if (segment != ".") {
+            segments << segment;
+        }
+    }
+    const QString key = segments.join('/');
+    if (!key.endsWith(".jpg", Qt::CaseInsensitive) && !key.endsWith(".jpeg", Qt::CaseInsensitive)) {
+        return QString();
+    }
+    return key;
+}
+
+QString ImageIndex::filePathForKey(const QString& key) const {
+    return QDir(root).filePath(key);
+}
+
+void ImageIndex::refreshFile(const QString& filePath) {
+    const QString key = keyForFile(filePath);
+    const ImageIndexEntry entry = readEntry(filePath);
+    QWriteLocker locker(&lock);
+    QStringList& known = directoryFiles[parentKey(key)];
+    if (entry.dimensions.isValid()) {
+        entries.insert(key, entry);
+        if (!known.contains(key)) {
+            known.append(key);
+        }
+    } else {
+        entries.remove(key);
+        known.removeAll(key);
+    }
+}
+
+void ImageIndex::onDirectoryChanged(const QString& path) {
+    if (!QFileInfo(path).isDir()) {
+        removeDirectory(keyForFile(path));
+        watcher->removePath(path);
+        return;
+    }
+    rescanDirectory(path);
+}
+
+QString ImageIndex::keyForFile(const QString& filePath) const {
+    const QString relative = QDir(root).relativeFilePath(filePath);
+    return relative == "." ? QString() : relative;
+}
+
+void ImageIndex::rescanDirectory(const QString& path) {
+    const QString dirKey = keyForFile(path);
+    const QStringList files = listJpegFiles(path);
+
+    QSet<QString> present;
+    QStringList changed;
+    {
+        QReadLocker locker(&lock);
+        for (const QString& file : files) {
+            const QString key = keyForFile(file);
+            present.insert(key);
+            QFileInfo info(file);
+            auto it = entries.constFind(key);
+            if (it == entries.constEnd() || it->size != info.size()
+                    || it->modified != info.lastModified().toMSecsSinceEpoch()) {
+                changed << file;
+            }
+        }
+    }
+
+    // Header reads happen outside the lock so lookups are never blocked on I/O.
+    QList<ImageIndexEntry> updated;
+    for (const QString& file : changed) {
+        updated << readEntry(file);
+    }
+
+    QStringList vanishedDirectories;
+    {
+        QWriteLocker locker(&lock);
+        QStringList& known = directoryFiles[dirKey];
+        for (const QString& key : known) {
+            if (!present.contains(key)) {
+                entries.remove(key);
+            }
+        }
+        for (const ImageIndexEntry& entry : updated) {
+            const QString key = keyForFile(entry.filePath);
+            if (entry.dimensions.isValid()) {
+                entries.insert(key, entry);
+            } else {
+                entries.remove(key);
+            }
+        }
+        known.clear();
+        for (const QString& key : present) {
+            if (entries.contains(key)) {
+                known.append(key);
+            }
+        }
+        for (auto it = directoryFiles.constBegin(); it != directoryFiles.constEnd(); ++it) {
+            if (!it.key().isEmpty() && it.key() != dirKey && parentKey(it.key()) == dirKey
+                    && !QFileInfo(filePathForKey(it.key())).isDir()) {
+                vanishedDirectories << it.key();
+            }
+        }
+    }
+    for (const QString& key : vanishedDirectories) {
+        removeDirectory(key);
+    }
+
+    const QStringList watched = watcher->directories();
+    const QSet<QString> watchedSet(watched.begin(), watched.end());
+    const QStringList subdirectories = QDir(path).entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+    for (const QString& name : subdirectories) {
+        const QString subdirectory = QDir(path).filePath(name);
+        if (!watchedSet.contains(subdirectory)) {
+            watcher->addPath(subdirectory);
+            rescanDirectory(subdirectory);
+        }
+    }
+
+    qDebug() << "Rescanned" << path << ":" << updated.size() << "updated," << present.size() << "present";
+}
+
+void ImageIndex::removeDirectory(const QString& dirKey) {
+    const QString prefix = dirKey.isEmpty() ? QString() : dirKey + '/';
+    QWriteLocker locker(&lock);
+    for (auto it = directoryFiles.begin(); it != directoryFiles.end();) {
+        if (it.key() == dirKey || it.key().startsWith(prefix)) {
+            for (const QString& key : it.value()) {
+                entries.remove(key);
+            }
+            it = directoryFiles.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef IMAGEINDEX_H
+#define IMAGEINDEX_H
+
+#include <QObject>
+#include <QHash>
+#include <QReadWriteLock>
+#include <QSize>
+#include <QString>
+#include <QStringList>
+
+class QFileSystemWatcher;
+
+struct ImageIndexEntry {
+    QString filePath;
+    qint64 size = 0;
+    qint64 modified = 0;
+    QSize dimensions;
+};
+
+// In-memory index of the JPEG files below a root directory, keyed by the
+// '/'-separated path relative to the root. The initial build stats and reads
+// the header of every file on the global thread pool; afterwards only the
+// directories reported by QFileSystemWatcher are rescanned, on the thread
+// that owns the index. lookup() and refreshFile() are thread-safe.
+class ImageIndex : public QObject {
+    Q_OBJECT
+public:
+    explicit ImageIndex(QObject* parent = nullptr);
+
+    bool build(const QString& rootPath);
+    QString rootPath() const { return root; }
+    int count() const;
+
+    bool lookup(const QString& relativePath, ImageIndexEntry& entry) const;
+    // Maps a request path ("/a/b.jpg", percent-encoded, optional query) to a
+    // relative key; empty if it escapes the root or is not a JPEG name.
+    static QString keyForRequestPath(const QByteArray& target);
+    QString filePathForKey(const QString& key) const;
+    void refreshFile(const QString& filePath);
+
+private slots:
+    void onDirectoryChanged(const QString& path);
+
+private:
+    QString keyForFile(const QString& filePath) const;
+    void rescanDirectory(const QString& path);
+    void removeDirectory(const QString& dirKey);
+
+    QString root;
+    QFileSystemWatcher* watcher;
+    mutable QReadWriteLock lock;
+    QHash<QString, ImageIndexEntry> entries;
+    QHash<QString, QStringList> directoryFiles;
+};
+
+#endif // IMAGEINDEX_H
@@ -0,0 +1,111 @@
+#include "imagescaler.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Mean of two 32-bit pixels per byte lane, rounded up like _mm_avg_epu8.
+inline quint32 average(quint32 a, quint32 b) {
+    return (a | b) - (((a ^ b) & 0xfefefefeu) >> 1);
+}
+
+void halveRow(const quint32* top, const quint32* bottom, quint32* out, int width, bool oddTail) {
+    int x = 0;
+#ifdef __SSE2__
+    for (; x + 2 <= width; x += 2) {
+        const __m128i rows = _mm_avg_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(top + 2 * x)),
+                                          _mm_loadu_si128(reinterpret_cast<const __m128i*>(bottom + 2 * x)));
+        const __m128i even = _mm_shuffle_epi32(rows, _MM_SHUFFLE(2, 0, 2, 0));
+        const __m128i odd = _mm_shuffle_epi32(rows, _MM_SHUFFLE(3, 1, 3, 1));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(out + x), _mm_avg_epu8(even, odd));
+    }
+#endif
+    for (; x < width; ++x) {
+        const bool last = oddTail && x == width - 1;
+        const int right = last ? 2 * x : 2 * x + 1;
+        out[x] = average(average(top[2 * x], bottom[2 * x]), average(top[right], bottom[right]));
+    }
+}
+
+}
+
+ImageScaler::ImageScaler(int cacheKBytes)
+    : chainKey(0), pixmaps(cacheKBytes) {}
+
+QImage ImageScaler::halve(const QImage& image) {
+    QImage source = image;
+    const QImage::Format format = image.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32;
+    if (source.format() != format) {
+        source = source.convertToFormat(format);
+    }
+
+    const int width = qMax(1, source.width() / 2);
+    const int height = qMax(1, source.height() / 2);
+    QImage result(width, height, format);
+    if (result.isNull()) {
+        return result;
+    }
+    // A 1-pixel-wide or -high source averages its single column or row with itself.
+    const bool oddTail = source.width() == 1;
+    for (int y = 0; y < height; ++y) {
+        const int topRow = qMin(2 * y, source.height() - 1);
+        const int bottomRow = qMin(2 * y + 1, source.height() - 1);
+        halveRow(reinterpret_cast<const quint32*>(source.constScanLine(topRow)),
+                 reinterpret_cast<const quint32*>(source.constScanLine(bottomRow)),
+                 reinterpret_cast<quint32*>(result.scanLine(y)), width, oddTail);
+    }
+    return result;
+}
+
+const QImage& ImageScaler::level(const QImage& image, const QSize& size) {
+    if (chainKey != image.cacheKey() || chain.isEmpty()) {
+        chain.clear();
+        chain.append(image);
+        chainKey = image.cacheKey();
+    }
+    // Smallest level that is still at least the requested size; halve
+    // further only as far as needed.
+    int index = 0;
+    while (true) {
+        const QSize levelSize = chain[index].size();
+        if (levelSize.width() < 2 * size.width() || levelSize.height() < 2 * size.height()
+                || levelSize.width() < 2 || levelSize.height() < 2) {
+            return chain[index];
+        }
+        if (index + 1 == chain.size()) {
+            chain.append(halve(chain[index]));
+        }
+        ++index;
+    }
+}
+
+QPixmap ImageScaler::pixmap(const QImage& image, const QSize& bounds, qreal devicePixelRatio) {
+    if (image.isNull() || bounds.isEmpty()) {
+        return QPixmap();
+    }
+    QSize size = image.size();
+    size.scale(bounds, Qt::KeepAspectRatio);
+    size = size.expandedTo(QSize(1, 1));
+
+    const QString key = QString("%1-%2x%3").arg(image.cacheKey()).arg(size.width()).arg(size.height());
+    if (QPixmap* cached = pixmaps.object(key)) {
+        return *cached;
+    }
+
+    const QImage& source = level(image, size);
+    QImage scaled = source.size() == size ? source
+                                          : source.scaled(size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    QPixmap* result = new QPixmap(QPixmap::fromImage(scaled));
+    result->setDevicePixelRatio(devicePixelRatio);
+    const QPixmap copy = *result;
+    pixmaps.insert(key, result, qMax<qint64>(1, qint64(size.width()) * size.height() * 4 / 1024));
+    return copy;
+}
+
+void ImageScaler::clear() {
+    chain.clear();
+    chainKey = 0;
+    pixmaps.clear();
+}
@@ -0,0 +1,37 @@
+#ifndef IMAGESCALER_H
+#define IMAGESCALER_H
+
+#include <QCache>
+#include <QImage>
+#include <QList>
+#include <QPixmap>
+#include <QSize>
+#include <QString>
+
+// Fits images to an on-screen size for display. Downscaling walks a mip
+// chain of 2x2 box-filtered halvings and smooth-scales only the last, at
+// most 2x, step. The chain of the most recent image and the pixmaps of
+// recent (image, size) pairs are cached, so resizes and re-shown scans do
+// not touch the full-resolution image again.
+class ImageScaler {
+public:
+    explicit ImageScaler(int cacheKBytes = 64 * 1024);
+
+    // Pixmap fitted inside bounds (device pixels), keeping the aspect ratio,
+    // tagged with devicePixelRatio.
+    QPixmap pixmap(const QImage& image, const QSize& bounds, qreal devicePixelRatio);
+    void clear();
+
+    // Half size (rounded down, at least 1x1), each pixel the mean of a 2x2
+    // block. The result is RGB32 or ARGB32_Premultiplied.
+    static QImage halve(const QImage& image);
+
+private:
+    const QImage& level(const QImage& image, const QSize& size);
+
+    qint64 chainKey;
+    QList<QImage> chain;
+    QCache<QString, QPixmap> pixmaps;
+};
+
+#endif // IMAGESCALER_H
@@ -0,0 +1,486 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QList>
+#include <QSslSocket>
+#include <QTextStream>
+#include <QTimer>
+#include <QVector>
+#include <QtAlgorithms>
+#include <cmath>
+#include <limits>
+#include "httpparser.h"
+#include "httprequest.h"
+
+// Load generator for jpeg_server and jpeg_server_secure. C persistent
+// connections issue GET (and optionally POST) requests framed by
+// HttpRequest, like JPEGClient's, with responses read through HttpParser.
+//
+// Closed loop (--rate 0): every connection sends its next request as soon
+// as the previous response is complete. Open loop (--rate R): requests are
+// scheduled at R per second regardless of how the server keeps up and are
+// queued on the connections in turn; latency is measured from the
+// scheduled time, so a stalled server shows up in the tail instead of
+// silently lowering the request rate.
+
+// HDR-style log-linear histogram of microsecond latencies. Values below
+// 2 * SubBuckets are exact; larger ones keep SubBucketBits + 1 significant
+// bits, i.e. at most 1/128 (under 1%) relative error, in a fixed array.
+class LatencyHistogram {
+public:
+    LatencyHistogram() : counts(BucketCount, 0), total(0), sum(0), minValue(0), maxValue(0) {}
+
+    void record(qint64 us) {
+        const quint64 value = quint64(qMax<qint64>(0, us));
+        ++counts[indexOf(value)];
+        if (total == 0 || value < minValue) {
+            minValue = value;
+        }
+        maxValue = qMax(maxValue, value);
+        sum += value;
+        ++total;
+    }
+
+    qint64 count() const { return total; }
+    qint64 min() const { return qint64(minValue); }
+    qint64 max() const { return qint64(maxValue); }
+    double mean() const { return total ? double(sum) / total : 0.0; }
+
+    // Highest value equivalent to the one at the given percentile.
+    qint64 valueAtPercentile(double percentile) const {
+        if (total == 0) {
+            return 0;
+        }
+        const qint64 target = qMax<qint64>(1, qint64(std::ceil(percentile / 100.0 * total)));
+        qint64 seen = 0;
+        for (int i = 0; i < BucketCount; ++i) {
+            seen += counts[i];
+            if (seen >= target) {
+                return qint64(qMin(highestEquivalent(i), maxValue));
+            }
+        }
+        return qint64(maxValue);
+    }
+
+    // Non-empty buckets as [highest equivalent value, count] pairs.
+    QJsonArray toJson() const {
+        QJsonArray buckets;
+        for (int i = 0; i < BucketCount; ++i) {
+            if (counts[i]) {
+                buckets.append(QJsonArray{ qint64(highestEquivalent(i)), counts[i] });
+            }
+        }
+        return buckets;
+    }
+
+private:
+    static const int SubBucketBits = 7;
+    static const int SubBuckets = 1 << SubBucketBits;
+    static const int BucketCount = (64 - SubBucketBits + 1) * SubBuckets;
+
+    static int indexOf(quint64 value) {
+        if (value < 2 * SubBuckets) {
+            return int(value);
+        }
+        // value >> shift lands in [SubBuckets, 2 * SubBuckets).
+        const int shift = 63 - qCountLeadingZeroBits(value) - SubBucketBits;
+        return (shift + 1) * SubBuckets + int((value >> shift) - SubBuckets);
+    }
+
+    static quint64 highestEquivalent(int index) {
+        if (index < 2 * SubBuckets) {
+            return quint64(index);
+        }
+        const int shift = index / SubBuckets - 1;
+        const quint64 lowest = quint64(index % SubBuckets + SubBuckets) << shift;
+        return lowest + (quint64(1) << shift) - 1;
+    }
+
+    QVector<qint64> counts;
+    qint64 total;
+    quint64 sum;
+    quint64 minValue;
+    quint64 maxValue;
+};
+
+struct BenchOptions {
+    QString host;
+    quint16 port = 0;
+    bool tls = false;
+    int connections = 1;
+    double rate = 0;
+    qint64 durationMs = 0;
+    qint64 drainMs = 0;
+    QByteArray path;
+    QByteArray postBody;
+    int postPercent = 0;
+};
+
+class LoadGenerator : public QObject {
+public:
+    explicit LoadGenerator(const BenchOptions& options) : options(options) {}
+
+    void start() {
+        clock.start();
+        endNs = options.durationMs * 1000000;
+        for (int i = 0; i < options.connections; ++i) {
+            Connection* connection = new Connection;
+            connections << connection;
+            openConnection(connection);
+        }
+        if (options.rate > 0) {
+            intervalNs = 1e9 / options.rate;
+            nextDueNs = 0;
+            scheduler.setTimerType(Qt::PreciseTimer);
+            connect(&scheduler, &QTimer::timeout, this, [this]() { scheduleDue(); });
+            scheduler.start(1);
+        }
+        QTimer::singleShot(options.durationMs, this, [this]() { stop(); });
+    }
+
+    ~LoadGenerator() {
+        qDeleteAll(connections);
+    }
+
+    QJsonObject report() const {
+        const double seconds = qMax<qint64>(1, lastCompletionNs) / 1e9;
+        QJsonObject latency;
+        latency["min"] = histogram.min();
+        latency["mean"] = histogram.mean();
+        latency["p50"] = histogram.valueAtPercentile(50);
+        latency["p90"] = histogram.valueAtPercentile(90);
+        latency["p99"] = histogram.valueAtPercentile(99);
+        latency["p99_9"] = histogram.valueAtPercentile(99.9);
+        latency["max"] = histogram.max();
+
+        QJsonObject result;
+        result["target"] = QString("%1:%2").arg(options.host).arg(options.port);
+        result["tls"] = options.tls;
+        result["connections"] = options.connections;
+        result["mode"] = options.rate > 0 ? "open" : "closed";
+        result["rate"] = options.rate;
+        result["duration_s"] = seconds;
+        result["requests"] = histogram.count();
+        result["get"] = getCount;
+        result["post"] = postCount;
+        result["errors"] = errorCount;
+        result["unfinished"] = unfinishedCount();
+        result["reconnects"] = reconnectCount;
+        result["throughput_rps"] = histogram.count() / seconds;
+        result["throughput_mib_s"] = bytesReceived / seconds / (1024 * 1024);
+        result["latency_us"] = latency;
+        result["histogram_us"] = histogram.toJson();
+        return result;
+    }
+
+private:
+    struct Connection {
+        QSslSocket* socket = nullptr;
+        QByteArray buffer;
+        HttpParser parser{HttpParser::Response};
+        bool ready = false;
+        bool inFlight = false;
+        bool headerDone = false;
+        bool closeAfter = false;
+        qint64 bodyRemaining = 0;
+        qint64 startNs = 0;
+        // Scheduled send times of requests not sent yet (open loop).
+        QList<qint64> queue;
+    };
+
+    void openConnection(Connection* connection) {
+        if (connection->socket) {
+            connection->socket->disconnect(this);
+            connection->socket->abort();
+            connection->socket->deleteLater();
+        }
+        connection->socket = new QSslSocket(this);
+        connection->ready = false;
+        connection->buffer.clear();
+        QSslSocket* socket = connection->socket;
+        auto onReady = [this, connection]() {
+            connection->ready = true;
+            sendNext(connection);
+        };
+        if (options.tls) {
+            connect(socket, &QSslSocket::encrypted, this, onReady);
+        } else {
+            connect(socket, &QSslSocket::connected, this, onReady);
+        }
+        connect(socket, &QSslSocket::readyRead, this, [this, connection]() { readResponse(connection); });
+        connect(socket, &QSslSocket::disconnected, this, [this, connection]() { connectionLost(connection); });
+        connect(socket, &QSslSocket::errorOccurred, this, [this, connection](QAbstractSocket::SocketError error) {
+            if (error != QAbstractSocket::RemoteHostClosedError) {
+                connectionLost(connection);
+            }
+        });
+        if (options.tls) {
+            socket->ignoreSslErrors();
+            socket->connectToHostEncrypted(options.host, options.port);
+        } else {
+            socket->connectToHost(options.host, options.port);
+        }
+    }
+
+    void scheduleDue() {
+        const qint64 now = clock.nsecsElapsed();
+        while (!stopping && nextDueNs <= now && nextDueNs < endNs) {
+            Connection* connection = connections[nextConnection];
+            nextConnection = (nextConnection + 1) % connections.size();
+            connection->queue << qint64(nextDueNs);
+            nextDueNs += intervalNs;
+            sendNext(connection);
+        }
+    }
+
+    void sendNext(Connection* connection) {
+        if (connection->inFlight || !connection->ready) {
+            return;
+        }
+        if (connection->queue.isEmpty()) {
+            if (options.rate > 0 || stopping) {
+                finishIfDrained();
+                return;
+            }
+            connection->queue << clock.nsecsElapsed();
+        }
+
+        const bool post = isPost(requestIndex++);
+        QByteArray request;
+        if (post) {
+            request = HttpRequest::imageUpload("/", options.host, options.postBody.size(), true);
+            ++postCount;
+        } else {
+            request = HttpRequest::imageGet(options.path, options.host, false, true);
+            ++getCount;
+        }
+        connection->startNs = connection->queue.takeFirst();
+        connection->inFlight = true;
+        connection->headerDone = false;
+        connection->closeAfter = false;
+        connection->parser.reset();
+        connection->socket->write(request);
+        if (post) {
+            connection->socket->write(options.postBody);
+        }
+    }
+
+    // Spreads POSTs evenly: request n is a POST when the running share
+    // of POSTs crosses a whole number.
+    bool isPost(qint64 n) const {
+        return (n + 1) * options.postPercent / 100 != n * options.postPercent / 100;
+    }
+
+    void readResponse(Connection* connection) {
+        connection->buffer += connection->socket->readAll();
+        if (!connection->inFlight) {
+            connection->buffer.clear();
+            return;
+        }
+        if (!connection->headerDone) {
+            HttpParser& parser = connection->parser;
+            const HttpParser::Status status = parser.parse(connection->buffer);
+            if (status == HttpParser::NeedMore) {
+                return;
+            }
+            if (status == HttpParser::Error || parser.statusCode() >= 400) {
+                ++errorCount;
+                connection->inFlight = false;
+                openConnection(connection);
+                ++reconnectCount;
+                return;
+            }
+            connection->headerDone = true;
+            connection->closeAfter = !parser.keepAlive();
+            // Without Content-Length the body runs until the server closes.
+            connection->bodyRemaining = parser.contentLength() >= 0 ? parser.contentLength()
+                                                                   : std::numeric_limits<qint64>::max();
+            if (parser.contentLength() < 0) {
+                connection->closeAfter = true;
+            }
+            bytesReceived += parser.headerSize();
+            connection->buffer.remove(0, parser.headerSize());
+        }
+
+        const qint64 take = qMin<qint64>(connection->bodyRemaining, connection->buffer.size());
+        connection->bodyRemaining -= take;
+        bytesReceived += take;
+        if (take == connection->buffer.size()) {
+            connection->buffer.clear();
+        } else {
+            connection->buffer.remove(0, take);
+        }
+        if (connection->bodyRemaining == 0) {
+            complete(connection);
+        }
+    }
+
+    void complete(Connection* connection) {
+        const qint64 now = clock.nsecsElapsed();
+        histogram.record((now - connection->startNs) / 1000);
+        lastCompletionNs = now;
+        connection->inFlight = false;
+        if (connection->closeAfter) {
+            ++reconnectCount;
+            openConnection(connection);
+            return;
+        }
+        sendNext(connection);
+    }
+
+    void connectionLost(Connection* connection) {
+        if (!connection->socket) {
+            return;
+        }
+        if (connection->inFlight && connection->headerDone
+                && connection->bodyRemaining == std::numeric_limits<qint64>::max()) {
+            complete(connection);
+            return;
+        }
+        if (connection->inFlight) {
+            ++errorCount;
+            connection->inFlight = false;
+        }
+        connection->ready = false;
+        connection->socket->disconnect(this);
+        connection->socket->deleteLater();
+        connection->socket = nullptr;
+        if (stopping) {
+            finishIfDrained();
+            return;
+        }
+        // Back off briefly so a server that is down does not spin the loop.
+        ++reconnectCount;
+        QTimer::singleShot(ReconnectDelayMs, this, [this, connection]() {
+            if (!connection->socket && !stopping) {
+                openConnection(connection);
+            }
+        });
+    }
+
+    void stop() {
+        stopping = true;
+        scheduler.stop();
+        QTimer::singleShot(options.drainMs, this, [this]() { QCoreApplication::quit(); });
+        finishIfDrained();
+    }
+
+    void finishIfDrained() {
+        if (!stopping || unfinishedCount() > 0) {
+            return;
+        }
+        QCoreApplication::quit();
+    }
+
+    int unfinishedCount() const {
+        int count = 0;
+        for (const Connection* connection : connections) {
+            count += int(connection->queue.size()) + (connection->inFlight ? 1 : 0);
+        }
+        return count;
+    }
+
+    static const int ReconnectDelayMs = 100;
+
+    BenchOptions options;
+    QList<Connection*> connections;
+    QElapsedTimer clock;
+    QTimer scheduler;
+    LatencyHistogram histogram;
+    qint64 endNs = 0;
+    double intervalNs = 0;
+    double nextDueNs = 0;
+    int nextConnection = 0;
+    bool stopping = false;
+    qint64 requestIndex = 0;
+    qint64 getCount = 0;
+    qint64 postCount = 0;
+    qint64 errorCount = 0;
+    qint64 reconnectCount = 0;
+    qint64 bytesReceived = 0;
+    qint64 lastCompletionNs = 0;
+};
+
+int main(int argc, char* argv[]) {
+    QCoreApplication app(argc, argv);
+    QCommandLineParser cli;
+    cli.setApplicationDescription("Load generator for jpeg_server and jpeg_server_secure");
+    cli.addHelpOption();
+    QCommandLineOption hostOpt("host", "Server address.", "host", "127.0.0.1");
+    QCommandLineOption portOpt({"p", "port"}, "Server port.", "port", "12345");
+    QCommandLineOption tlsOpt("tls", "Connect with TLS (jpeg_server_secure).");
+    QCommandLineOption connectionsOpt({"c", "connections"}, "Concurrent connections.", "count", "8");
+    QCommandLineOption rateOpt({"r", "rate"}, "Requests per second over all connections; 0 sends as fast as possible.",
+                               "rps", "0");
+    QCommandLineOption durationOpt({"d", "duration"}, "Seconds to issue requests for.", "seconds", "10");
+    QCommandLineOption drainOpt("drain", "Seconds to wait for outstanding responses afterwards.", "seconds", "5");
+    QCommandLineOption pathOpt("path", "Request target of the GETs.", "path", "/");
+    QCommandLineOption postOpt("post", "JPEG file sent as POST body.", "file");
+    QCommandLineOption postPercentOpt("post-percent", "Share of requests that are POSTs (needs --post).", "percent", "0");
+    QCommandLineOption jsonOpt("json", "Write the results as JSON to this file ('-' for stdout).", "file");
+    cli.addOptions({ hostOpt, portOpt, tlsOpt, connectionsOpt, rateOpt, durationOpt, drainOpt,
+                     pathOpt, postOpt, postPercentOpt, jsonOpt });
+    cli.process(app);
+
+    BenchOptions options;
+    options.host = cli.value(hostOpt);
+    options.port = cli.value(portOpt).toUShort();
+    options.tls = cli.isSet(tlsOpt);
+    options.connections = qMax(1, cli.value(connectionsOpt).toInt());
+    options.rate = qMax(0.0, cli.value(rateOpt).toDouble());
+    options.durationMs = qMax<qint64>(1, qint64(cli.value(durationOpt).toDouble() * 1000));
+    options.drainMs = qMax<qint64>(0, qint64(cli.value(drainOpt).toDouble() * 1000));
+    options.path = cli.value(pathOpt).toUtf8();
+    options.postPercent = qBound(0, cli.value(postPercentOpt).toInt(), 100);
+    if (options.port == 0) {
+        qCritical() << "Invalid port";
+        return 1;
+    }
+    if (options.postPercent > 0) {
+        QFile file(cli.value(postOpt));
+        if (!cli.isSet(postOpt) || !file.open(QIODevice::ReadOnly)) {
+            qCritical() << "--post-percent needs a readable --post file";
+            return 1;
+        }
+        options.postBody = file.readAll();
+    }
+
+    LoadGenerator generator(options);
+    generator.start();
+    app.exec();
+
+    const QJsonObject result = generator.report();
+    const QJsonObject latency = result["latency_us"].toObject();
+    QTextStream out(stdout);
+    out << QString("%1 requests (%2 GET, %3 POST) over %4 %5 connections in %6 s, %7 errors, %8 unfinished\n")
+           .arg(result["requests"].toInteger()).arg(result["get"].toInteger()).arg(result["post"].toInteger())
+           .arg(options.connections).arg(options.tls ? "TLS" : "plain")
+           .arg(result["duration_s"].toDouble(), 0, 'f', 2)
+           .arg(result["errors"].toInteger()).arg(result["unfinished"].toInteger());
+    out << QString("throughput: %1 req/s, %2 MiB/s\n")
+           .arg(result["throughput_rps"].toDouble(), 0, 'f', 1)
+           .arg(result["throughput_mib_s"].toDouble(), 0, 'f', 2);
+    out << QString("latency us: p50 %1  p90 %2  p99 %3  p99.9 %4  max %5\n")
+           .arg(latency["p50"].toInteger()).arg(latency["p90"].toInteger()).arg(latency["p99"].toInteger())
+           .arg(latency["p99_9"].toInteger()).arg(latency["max"].toInteger());
+    out.flush();
+
+    if (cli.isSet(jsonOpt)) {
+        const QByteArray json = QJsonDocument(result).toJson();
+        if (cli.value(jsonOpt) == "-") {
+            out << json;
+        } else {
+            QFile file(cli.value(jsonOpt));
+            if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(json) != json.size()) {
+                qCritical() << "Failed to write" << cli.value(jsonOpt);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
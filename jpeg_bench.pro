@@ -0,0 +1,15 @@
+QT = core network
+
+CONFIG += c++17 console
+
+TARGET = jpeg_bench
+TEMPLATE = app
+
+SOURCES += \
+    jpeg_bench.cpp \
+    httpparser.cpp \
+    httprequest.cpp
+
+HEADERS += \
+    httpparser.h \
+    httprequest.h
@@ -0,0 +1,218 @@
+#include <QBuffer>
+#include <QImageWriter>
+#include <QTemporaryDir>
+#include <QtTest/QtTest>
+#include "benchimage.h"
+#include "boxblur.h"
+#include "imagehandler.h"
+#include "jpegencoder.h"
+#include "jpegstrategy.h"
+
+// QBENCHMARK suite for the code paths in jpegstrategy.cpp and its helpers,
+// run against a synthetic corpus written to a temporary directory:
+// three sizes, 4:2:0 and 4:4:4 chroma, baseline and progressive. Compare
+// runs before and after a change, e.g.
+//   jpeg_kernels_bench -median 5 standardLoad
+// Use -tickcounter or -callgrind for steadier numbers than wall time.
+
+class JPEGKernelsBench : public QObject {
+    Q_OBJECT
+private slots:
+    void initTestCase();
+
+    void standardLoad_data() { corpusData(); }
+    void standardLoad();
+    void progressiveLoad_data() { corpusData(); }
+    void progressiveLoad();
+    void progressiveAllScans_data() { corpusData(); }
+    void progressiveAllScans();
+    void standardSave_data() { encodeData(); }
+    void standardSave();
+    void encodeToBuffer_data() { encodeData(); }
+    void encodeToBuffer();
+    void qtWriterToBuffer_data() { encodeData(); }
+    void qtWriterToBuffer();
+    void blockBlur_data();
+    void blockBlur();
+    void createHandler_data();
+    void createHandler();
+
+private:
+    struct Sample {
+        QString name;
+        QSize size;
+        int subsampling;
+        bool progressive;
+    };
+
+    void corpusData();
+    void encodeData();
+
+    QTemporaryDir corpusDir;
+    QList<Sample> samples;
+    QHash<QString, QImage> sources;
+};
+
+void JPEGKernelsBench::initTestCase() {
+    QVERIFY(corpusDir.isValid());
+    const QSize sizes[] = { QSize(640, 480), QSize(1920, 1080), QSize(4000, 3000) };
+    const struct { int value; const char* name; } subsamplings[] = {
+        { JPEGEncoder::Subsampling420, "420" }, { JPEGEncoder::Subsampling444, "444" }
+    };
+    for (const QSize& size : sizes) {
+        const QString sizeName = QString("%1x%2").arg(size.width()).arg(size.height());
+        sources.insert(sizeName, BenchImage::gradientNoise(size));
+        for (const auto& subsampling : subsamplings) {
+            for (bool progressive : { false, true }) {
+                Sample sample;
+                sample.name = QString("%1-%2-%3").arg(sizeName, subsampling.name,
+                                                      progressive ? "progressive" : "baseline");
+                sample.size = size;
+                sample.subsampling = subsampling.value;
+                sample.progressive = progressive;
+                JPEGEncoder::Options options;
+                options.quality = 85;
+                options.progressive = progressive;
+                options.subsampling = subsampling.value;
+                QVERIFY(JPEGEncoder::save(corpusDir.filePath(sample.name + ".jpg"), sources.value(sizeName), options));
+                samples << sample;
+            }
+        }
+    }
+}
+
+void JPEGKernelsBench::corpusData() {
+    QTest::addColumn<QString>("filename");
+    for (const Sample& sample : std::as_const(samples)) {
+        QTest::newRow(qPrintable(sample.name)) << corpusDir.filePath(sample.name + ".jpg");
+    }
+}
+
+void JPEGKernelsBench::encodeData() {
+    QTest::addColumn<QString>("source");
+    QTest::addColumn<int>("subsampling");
+    QTest::addColumn<bool>("progressive");
+    for (const Sample& sample : std::as_const(samples)) {
+        QTest::newRow(qPrintable(sample.name))
+            << QString("%1x%2").arg(sample.size.width()).arg(sample.size.height())
+            << sample.subsampling << sample.progressive;
+    }
+}
+
+void JPEGKernelsBench::standardLoad() {
+    QFETCH(QString, filename);
+    StandardJPEGStrategy strategy;
+    QImage image;
+    QBENCHMARK {
+        QVERIFY(strategy.loadImage(filename, image));
+    }
+}
+
+// First scan only: a real DC scan for progressive files, the 1/8 decode
+// plus upscale for baseline ones.
+void JPEGKernelsBench::progressiveLoad() {
+    QFETCH(QString, filename);
+    ProgressiveJPEGStrategy strategy;
+    QImage image;
+    QBENCHMARK {
+        QVERIFY(strategy.loadImage(filename, image));
+    }
+}
+
+void JPEGKernelsBench::progressiveAllScans() {
+    QFETCH(QString, filename);
+    ProgressiveJPEGStrategy strategy;
+    QImage image;
+    QBENCHMARK {
+        QVERIFY(strategy.loadImage(filename, image));
+        while (strategy.hasMoreScans()) {
+            QVERIFY(strategy.loadNextScan(image));
+        }
+    }
+}
+
+void JPEGKernelsBench::standardSave() {
+    QFETCH(QString, source);
+    QFETCH(int, subsampling);
+    QFETCH(bool, progressive);
+    const QImage image = sources.value(source);
+    const QString filename = corpusDir.filePath("save.jpg");
+    StandardJPEGStrategy strategy;
+    QBENCHMARK {
+        QVERIFY(strategy.saveImage(filename, image, 85, progressive, JPEGEncoder::DctInteger, subsampling));
+    }
+}
+
+void JPEGKernelsBench::encodeToBuffer() {
+    QFETCH(QString, source);
+    QFETCH(int, subsampling);
+    QFETCH(bool, progressive);
+    const QImage image = sources.value(source);
+    JPEGEncoder::Options options;
+    options.quality = 85;
+    options.progressive = progressive;
+    options.subsampling = subsampling;
+    QByteArray output;
+    QBENCHMARK {
+        output.clear();
+        QVERIFY(JPEGEncoder::encode(image, options, output));
+    }
+}
+
+// Qt's own writer into a QBuffer, the path the servers used before
+// JPEGEncoder; it only knows quality and the progressive flag.
+void JPEGKernelsBench::qtWriterToBuffer() {
+    QFETCH(QString, source);
+    QFETCH(int, subsampling);
+    QFETCH(bool, progressive);
+    Q_UNUSED(subsampling);
+    const QImage image = sources.value(source);
+    QBENCHMARK {
+        QByteArray output;
+        QBuffer buffer(&output);
+        buffer.open(QIODevice::WriteOnly);
+        QImageWriter writer(&buffer, "JPEG");
+        writer.setQuality(85);
+        writer.setProgressiveScanWrite(progressive);
+        QVERIFY(writer.write(image));
+    }
+}
+
+// The blur behind emulated scans (ProgressiveJPEGStrategy's former
+// applyBlur), at the radii loadNextScan() uses.
+void JPEGKernelsBench::blockBlur_data() {
+    QTest::addColumn<QString>("source");
+    QTest::addColumn<int>("radius");
+    for (const QString& source : { QString("640x480"), QString("1920x1080"), QString("4000x3000") }) {
+        for (int radius : { 2, 4, 6, 8 }) {
+            QTest::newRow(qPrintable(QString("%1-r%2").arg(source).arg(radius))) << source << radius;
+        }
+    }
+}
+
+void JPEGKernelsBench::blockBlur() {
+    QFETCH(QString, source);
+    QFETCH(int, radius);
+    const QImage image = sources.value(source);
+    QImage result;
+    QBENCHMARK {
+        result = BoxBlur::blockBlur(image, radius);
+    }
+    QCOMPARE(result.size(), image.size());
+}
+
+void JPEGKernelsBench::createHandler_data() {
+    QTest::addColumn<int>("type");
+    QTest::newRow("standard") << int(ImageHandler::Standard);
+    QTest::newRow("progressive") << int(ImageHandler::Progressive);
+}
+
+void JPEGKernelsBench::createHandler() {
+    QFETCH(int, type);
+    QBENCHMARK {
+        delete ImageHandler::createHandler(ImageHandler::HandlerType(type));
+    }
+}
+
+QTEST_GUILESS_MAIN(JPEGKernelsBench)
+#include "jpeg_kernels_bench.moc"
@@ -0,0 +1,25 @@
+QT = core gui concurrent testlib
+
+CONFIG += c++17 console
+
+TARGET = jpeg_kernels_bench
+TEMPLATE = app
+
+LIBS += -ljpeg
+
+SOURCES += \
+    jpeg_kernels_bench.cpp \
+    benchimage.cpp \
+    jpegstrategy.cpp \
+    jpegscandecoder.cpp \
+    jpegencoder.cpp \
+    boxblur.cpp \
+    imagehandler.cpp
+
+HEADERS += \
+    benchimage.h \
+    jpegstrategy.h \
+    jpegscandecoder.h \
+    jpegencoder.h \
+    boxblur.h \
+    imagehandler.h
@@ -1,15 +1,39 @@
-QT += core network
+QT += core network concurrent
 
 CONFIG += c++17 console
 
 TARGET = jpeg_server
 TEMPLATE = app
 
+LIBS += -ljpeg
+
 SOURCES += \
     jpegserver_main.cpp \
     jpegserver.cpp \
-    jpegstrategy.cpp
+    filesender.cpp \
+    jpegstrategy.cpp \
+    boxblur.cpp \
+    jpegencoder.cpp \
+    jpegscandecoder.cpp \
+    httpparser.cpp \
+    responsecache.cpp \
+    serverthreadpool.cpp \
+    jpegservice.cpp \
+    servermetrics.cpp \
+    jpegconnection.cpp \
+    imageindex.cpp
 
 HEADERS += \
     jpegserver.h \
-    jpegstrategy.h
+    filesender.h \
+    jpegstrategy.h \
+    boxblur.h \
+    jpegencoder.h \
+    jpegscandecoder.h \
+    httpparser.h \
+    responsecache.h \
+    serverthreadpool.h \
+    jpegservice.h \
+    servermetrics.h \
+    jpegconnection.h \
+    imageindex.h
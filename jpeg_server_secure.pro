@@ -1,16 +1,40 @@
-QT += core network
+QT += core network concurrent
 
 CONFIG += c++17 console
 
 TARGET = jpeg_server_secure
 TEMPLATE = app
 
+LIBS += -ljpeg
+
 SOURCES += \
     jpegserver_secure_main.cpp \
     jpegserver_secure.cpp \
-    jpegstrategy.cpp
+    filesender.cpp \
+    jpegstrategy.cpp \
+    boxblur.cpp \
+    jpegencoder.cpp \
+    jpegscandecoder.cpp \
+    httpparser.cpp \
+    responsecache.cpp \
+    serverthreadpool.cpp \
+    jpegservice.cpp \
+    servermetrics.cpp \
+    jpegconnection.cpp \
+    imageindex.cpp
 
 HEADERS += \
     jpegserver_secure.h \
-    jpegstrategy.h
+    filesender.h \
+    jpegstrategy.h \
+    boxblur.h \
+    jpegencoder.h \
+    jpegscandecoder.h \
+    httpparser.h \
+    responsecache.h \
+    serverthreadpool.h \
+    jpegservice.h \
+    servermetrics.h \
+    jpegconnection.h \
+    imageindex.h
 
@@ -1,32 +1,62 @@
-QT += core gui widgets network
+QT += core gui widgets network concurrent
 
 CONFIG += c++17
 
 TARGET = jpeg_viewer
 TEMPLATE = app
 
+LIBS += -ljpeg
+
 SOURCES += \
     main.cpp \
     mainwindow.cpp \
     jpegclient.cpp \
     jpegclient_secure.cpp \
     jpegserver.cpp \
+    filesender.cpp \
     jpegserver_secure.cpp \
     jpegloader.cpp \
     jpegsaver.cpp \
     imagehandler.cpp \
     jpegstrategy.cpp \
-    servermanager.cpp
+    boxblur.cpp \
+    jpegencoder.cpp \
+    jpegscandecoder.cpp \
+    httpparser.cpp \
+    httprequest.cpp \
+    responsecache.cpp \
+    serverthreadpool.cpp \
+    jpegservice.cpp \
+    servermetrics.cpp \
+    jpegconnection.cpp \
+    imageindex.cpp \
+    servermanager.cpp \
+    scanpyramid.cpp \
+    imagescaler.cpp
 
 HEADERS += \
     mainwindow.h \
     jpegclient.h \
     jpegclient_secure.h \
     jpegserver.h \
+    filesender.h \
     jpegserver_secure.h \
     jpegloader.h \
     jpegsaver.h \
     imagehandler.h \
     jpegstrategy.h \
-    servermanager.h
+    boxblur.h \
+    jpegencoder.h \
+    jpegscandecoder.h \
+    httpparser.h \
+    httprequest.h \
+    responsecache.h \
+    serverthreadpool.h \
+    jpegservice.h \
+    servermetrics.h \
+    jpegconnection.h \
+    imageindex.h \
+    servermanager.h \
+    scanpyramid.h \
+    imagescaler.h
 
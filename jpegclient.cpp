@@ -1,283 +1,760 @@
 #include "jpegclient.h"
+#include "httprequest.h"
 #include <QtNetwork/QHostAddress>
 #include <QBuffer>
 #include <QImageReader>
 #include <QFile>
-#include <QFileInfo>
+#include <QTimer>
 #include <QDebug>
+#include <cstring>
 
 JPEGClient::JPEGClient(QObject* parent)
-    : QObject(parent), socket(new QTcpSocket(this)), headerParsed(false), contentLength(0), mode(None) {
-    connect(socket, &QTcpSocket::readyRead, this, &JPEGClient::onReadyRead);
-    connect(socket, QOverload<QAbstractSocket::SocketError>::of(&QTcpSocket::errorOccurred),
-            this, &JPEGClient::onError);
-    connect(socket, &QTcpSocket::connected, [this]() {
-        qDebug() << "Connected to server";
-    });
-    connect(socket, &QTcpSocket::disconnected, [this]() {
-        qDebug() << "Disconnected from server";
+    : QObject(parent), nextRequestId(1) {}
+
+JPEGClient::~JPEGClient() {
+    for (Request* request : std::as_const(requests)) {
+        releaseSocket(request);
+        releaseSegments(request);
+        delete request;
+    }
+}
+
+JPEGClient::Request* JPEGClient::createRequest(RequestKind kind, const QString& host, quint16 port) {
+    Request* request = new Request;
+    request->id = nextRequestId++;
+    request->kind = kind;
+    request->host = host;
+    request->port = port;
+    request->timer = new QTimer(this);
+    request->timer->setSingleShot(true);
+    const int id = request->id;
+    connect(request->timer, &QTimer::timeout, this, [this, id]() { onTimeout(id); });
+    request->decoder.setLatestScanOnly(true);
+    request->started.start();
+    requests.insert(id, request);
+    return request;
+}
+
+// Completion is always reported asynchronously, even for invalid arguments,
+// so callers can store the returned id first.
+void JPEGClient::failLater(Request* request, const QString& message) {
+    const int id = request->id;
+    QTimer::singleShot(0, this, [this, id, message]() {
+        if (Request* pending = requests.value(id)) {
+            finish(pending, false, message);
+        }
     });
 }
 
-void JPEGClient::getImage(const QString& host, quint16 port) {
+int JPEGClient::getImage(const QString& host, quint16 port, int connections) {
+    Request* request = createRequest(GetImage, host, port);
+    request->connections = qBound(1, connections, MaxConnections);
     // Валидация входных данных
     if (host.isEmpty()) {
-        emit errorOccurred("Host address is empty");
-        return;
+        failLater(request, "Host address is empty");
+    } else if (port == 0) {
+        failLater(request, "Invalid port number");
+    } else {
+        connectSocket(request);
     }
-    if (port == 0 || port > 65535) {
-        emit errorOccurred("Invalid port number");
-        return;
+    return request->id;
+}
+
+int JPEGClient::uploadImage(const QString& host, quint16 port, const QString& filename) {
+    Request* request = createRequest(UploadImage, host, port);
+    if (host.isEmpty()) {
+        failLater(request, "Host address is empty");
+        return request->id;
+    }
+    if (port == 0) {
+        failLater(request, "Invalid port number");
+        return request->id;
+    }
+
+    QFile& file = request->uploadFile;
+    file.setFileName(filename);
+    if (!file.exists()) {
+        failLater(request, "File does not exist: " + filename);
+        return request->id;
+    }
+    if (!file.open(QIODevice::ReadOnly)) {
+        failLater(request, "Unable to open file for reading: " + filename);
+        return request->id;
+    }
+    request->uploadTotal = file.size();
+    if (request->uploadTotal <= 0) {
+        failLater(request, "File is empty: " + filename);
+        return request->id;
     }
 
-    buffer.clear();
-    headerParsed = false;
-    contentLength = 0;
-    uploadBuffer.clear();
-    mode = GetImage;
+    qDebug() << "Uploading" << filename << "(" << request->uploadTotal << "bytes) to" << host << ":" << port;
+    connectSocket(request);
+    return request->id;
+}
+
+void JPEGClient::abort(int requestId) {
+    if (Request* request = requests.value(requestId)) {
+        finish(request, false, "Request aborted");
+    }
+}
+
+QTcpSocket* JPEGClient::createSocket() {
+    return new QTcpSocket(this);
+}
 
-    qDebug() << "Connecting to" << host << ":" << port;
-    socket->abort();
+void JPEGClient::startConnection(QTcpSocket* socket, const QString& host, quint16 port,
+                                 const std::function<void()>& ready) {
+    connect(socket, &QTcpSocket::connected, this, ready);
     socket->connectToHost(host, port);
-    
-    if (!socket->waitForConnected(5000)) {
-        QString errorMsg = QString("Connection failed: %1").arg(socket->errorString());
-        qWarning() << errorMsg;
-        emit errorOccurred(errorMsg);
-        mode = None;
+}
+
+void JPEGClient::connectSocket(Request* request) {
+    releaseSocket(request);
+    QTcpSocket* socket = createSocket();
+    request->socket = socket;
+    request->connected = false;
+    const int id = request->id;
+    connect(socket, &QTcpSocket::readyRead, this, [this, id]() { onReadyRead(id); });
+    connect(socket, &QTcpSocket::bytesWritten, this, [this, id](qint64 bytes) { onBytesWritten(id, bytes); });
+    connect(socket, &QTcpSocket::errorOccurred, this, [this, id](QAbstractSocket::SocketError error) {
+        onError(id, error);
+    });
+
+    qDebug() << "Connecting to" << request->host << ":" << request->port << "request" << id;
+    request->timer->start(ConnectTimeoutMs);
+    startConnection(socket, request->host, request->port, [this, id]() {
+        qDebug() << "Connected to server, request" << id;
+        onConnected(id);
+    });
+}
+
+void JPEGClient::releaseSocket(Request* request) {
+    if (!request->socket) {
         return;
     }
+    request->socket->disconnect(this);
+    request->socket->abort();
+    request->socket->deleteLater();
+    request->socket = nullptr;
+}
 
-    QByteArray request = "GET / HTTP/1.1\r\n"
-                        "Host: " + host.toUtf8() + "\r\n"
-                        "Connection: close\r\n"
-                        "\r\n";
-    
-    qint64 written = socket->write(request);
-    if (written != request.size()) {
-        QString errorMsg = QString("Failed to send request: %1").arg(socket->errorString());
-        qWarning() << errorMsg;
-        emit errorOccurred(errorMsg);
-        socket->disconnectFromHost();
-        mode = None;
+void JPEGClient::onConnected(int requestId) {
+    Request* request = requests.value(requestId);
+    if (!request) {
         return;
     }
+    request->connected = true;
+    request->timer->start(IdleTimeoutMs);
+    if (request->kind == GetImage) {
+        sendGetRequest(request);
+    } else {
+        sendUploadRequest(request);
+    }
+}
 
-    if (!socket->waitForBytesWritten(3000)) {
-        QString errorMsg = QString("Write timeout: %1").arg(socket->errorString());
-        qWarning() << errorMsg;
-        emit errorOccurred(errorMsg);
-        socket->disconnectFromHost();
-        mode = None;
+void JPEGClient::sendGetRequest(Request* request) {
+    // A resume asks only for the missing tail; If-Range makes the server
+    // send the whole image instead if it changed since the first attempt.
+    const QByteArray header = request->body.isEmpty()
+        ? HttpRequest::imageGet("/", request->host, true, false)
+        : HttpRequest::imageGet("/", request->host, true, false, request->body.size(), -1, request->entityTag);
+
+    if (request->socket->write(header) != header.size()) {
+        finish(request, false, QString("Failed to send request: %1").arg(request->socket->errorString()));
         return;
     }
+    qDebug() << "GET request" << request->id << "sent, waiting for response";
+}
+
+void JPEGClient::sendUploadRequest(Request* request) {
+    const QByteArray header = HttpRequest::imageUpload("/", request->host, request->uploadTotal, false);
 
-    qDebug() << "GET request sent, waiting for response";
+    if (request->socket->write(header) != header.size()) {
+        finish(request, false, QString("Write header failed: %1").arg(request->socket->errorString()));
+        return;
+    }
+    request->uploadHeaderBytes = header.size();
+    qDebug() << "Upload request" << request->id << "started";
+    writeUploadChunk(request);
 }
 
-void JPEGClient::uploadImage(const QString& host, quint16 port, const QString& filename) {
-    if (host.isEmpty()) {
-        emit uploadFinished(false, "Host address is empty");
+// Reads the next chunk only once the socket has drained below
+// UploadChunkSize, so memory stays constant whatever the file size.
+void JPEGClient::writeUploadChunk(Request* request) {
+    QFile& file = request->uploadFile;
+    if (request->socket->bytesToWrite() >= UploadChunkSize || file.atEnd()) {
         return;
     }
-    if (port == 0 || port > 65535) {
-        emit uploadFinished(false, "Invalid port number");
+    const QByteArray chunk = file.read(UploadChunkSize);
+    if (chunk.isEmpty()) {
+        finish(request, false, QString("Read from file failed: %1").arg(file.errorString()));
         return;
     }
+    if (request->socket->write(chunk) != chunk.size()) {
+        finish(request, false, QString("Write body failed: %1").arg(request->socket->errorString()));
+        return;
+    }
+    if (file.atEnd()) {
+        qDebug() << "Upload request" << request->id << "fully queued, waiting for server response";
+    }
+}
 
-    QFile file(filename);
-    if (!file.exists()) {
-        emit uploadFinished(false, "File does not exist: " + filename);
+void JPEGClient::onBytesWritten(int requestId, qint64 bytes) {
+    Request* request = requests.value(requestId);
+    if (!request) {
         return;
     }
-    if (!file.open(QIODevice::ReadOnly)) {
-        emit uploadFinished(false, "Unable to open file for reading: " + filename);
+    request->timer->start(IdleTimeoutMs);
+    if (request->kind != UploadImage) {
         return;
     }
-    
-    QByteArray data = file.readAll();
-    file.close();
+    request->socketBytesWritten += bytes;
+    const qint64 sent = qBound<qint64>(0, request->socketBytesWritten - request->uploadHeaderBytes, request->uploadTotal);
+    if (sent > request->uploadSent) {
+        request->uploadSent = sent;
+        emit uploadProgress(requestId, sent, request->uploadTotal);
+        if (!requests.contains(requestId)) {
+            return;
+        }
+    }
+    writeUploadChunk(request);
+}
 
-    if (data.isEmpty()) {
-        emit uploadFinished(false, "File is empty: " + filename);
+bool JPEGClient::canResume(const Request* request) const {
+    return request->kind == GetImage && request->rangesAccepted && !request->entityTag.isEmpty()
+        && !request->entityTag.startsWith("W/") && !request->body.isEmpty()
+        && request->body.size() < request->contentLength && request->resumeAttempts < MaxResumeAttempts;
+}
+
+void JPEGClient::scheduleResume(Request* request) {
+    releaseSocket(request);
+    request->timer->stop();
+    const int id = request->id;
+    QTimer::singleShot(ResumeDelayMs * (request->resumeAttempts + 1), this, [this, id]() { resumeDownload(id); });
+}
+
+void JPEGClient::resumeDownload(int requestId) {
+    Request* request = requests.value(requestId);
+    if (!request) {
         return;
     }
+    ++request->resumeAttempts;
+    qDebug() << "Resuming download" << requestId << "from byte" << request->body.size() << "of"
+             << request->contentLength << "attempt" << request->resumeAttempts;
+    request->buffer.clear();
+    request->headerParsed = false;
+    request->responseParser.reset();
+    connectSocket(request);
+}
 
-    buffer.clear();
-    headerParsed = false;
-    contentLength = 0;
-    uploadBuffer = data;
-    mode = UploadImage;
+void JPEGClient::onReadyRead(int requestId) {
+    Request* request = requests.value(requestId);
+    if (!request || !request->socket) {
+        return;
+    }
+    request->buffer += request->socket->readAll();
+    request->timer->start(IdleTimeoutMs);
+    if (request->kind == GetImage) {
+        readGetResponse(request);
+    } else {
+        readUploadResponse(request);
+    }
+}
 
-    qDebug() << "Uploading" << filename << "(" << data.size() << "bytes) to" << host << ":" << port;
-    socket->abort();
-    socket->connectToHost(host, port);
-    
-    if (!socket->waitForConnected(10000)) {
-        mode = None;
-        QString errorMsg = QString("Connection failed: %1").arg(socket->errorString());
-        qWarning() << errorMsg;
-        emit uploadFinished(false, errorMsg);
-        return;
-    }
-
-    QByteArray request;
-    request += "POST / HTTP/1.1\r\n";
-    request += "Host: " + host.toUtf8() + "\r\n";
-    request += "Content-Type: image/jpeg\r\n";
-    request += "Content-Length: " + QByteArray::number(uploadBuffer.size()) + "\r\n";
-    request += "Connection: close\r\n";
-    request += "\r\n";
-    
-    qint64 written = socket->write(request);
-    if (written != request.size()) {
-        mode = None;
-        QString errorMsg = QString("Write header failed: %1").arg(socket->errorString());
-        qWarning() << errorMsg;
-        emit uploadFinished(false, errorMsg);
-        socket->disconnectFromHost();
-        return;
-    }
-    
-    if (!socket->waitForBytesWritten(5000)) {
-        mode = None;
-        QString errorMsg = QString("Write timeout (header): %1").arg(socket->errorString());
-        qWarning() << errorMsg;
-        emit uploadFinished(false, errorMsg);
-        socket->disconnectFromHost();
-        return;
-    }
-
-    written = socket->write(uploadBuffer);
-    if (written != uploadBuffer.size()) {
-        mode = None;
-        QString errorMsg = QString("Write body failed: %1").arg(socket->errorString());
-        qWarning() << errorMsg;
-        emit uploadFinished(false, errorMsg);
-        socket->disconnectFromHost();
-        return;
-    }
-    
-    if (!socket->waitForBytesWritten(10000)) {
-        mode = None;
-        QString errorMsg = QString("Write timeout (body): %1").arg(socket->errorString());
-        qWarning() << errorMsg;
-        emit uploadFinished(false, errorMsg);
-        socket->disconnectFromHost();
-        return;
-    }
-
-    qDebug() << "Upload data sent, waiting for server response";
-}
-
-void JPEGClient::onReadyRead() {
-    buffer += socket->readAll();
-
-    if (mode == GetImage) {
-        if (!headerParsed) {
-            int headerEnd = buffer.indexOf("\r\n\r\n");
-            if (headerEnd != -1) {
-                QByteArray header = buffer.left(headerEnd);
-                buffer = buffer.mid(headerEnd + 4);
-                QList<QByteArray> lines = header.split('\n');
-                for (const QByteArray& line : lines) {
-                    QByteArray trimmedLine = line.trimmed();
-                    if (trimmedLine.toLower().startsWith("content-length:")) {
-                        bool ok;
-                        contentLength = trimmedLine.mid(15).trimmed().toInt(&ok);
-                        if (!ok) {
-                            contentLength = 0;
-                        }
-                        qDebug() << "Content-Length:" << contentLength;
-                    }
-                }
-                headerParsed = true;
-            } else {
+void JPEGClient::readGetResponse(Request* request) {
+    if (!request->headerParsed) {
+        HttpParser& parser = request->responseParser;
+        HttpParser::Status status = parser.parse(request->buffer);
+        if (status == HttpParser::NeedMore) {
+            return;
+        }
+        if (status == HttpParser::Error) {
+            qWarning() << "Malformed response header:" << parser.errorString();
+            finish(request, false, "Invalid server response format");
+            return;
+        }
+        const int code = parser.statusCode();
+        if (code == 206 && !request->body.isEmpty()) {
+            qint64 first = 0;
+            qint64 last = 0;
+            qint64 total = 0;
+            if (!HttpParser::parseContentRange(parser.header("Content-Range"), first, last, total)
+                    || first != request->body.size() || total != request->contentLength) {
+                qWarning() << "Unexpected Content-Range in resumed response:" << parser.header("Content-Range");
+                finish(request, false, "Invalid resumed response");
                 return;
             }
-        }
-        
-        if (headerParsed) {
-            if (contentLength > 0) {
-                if (buffer.size() >= contentLength) {
-                    QImage img;
-                    if (img.loadFromData(buffer.left(contentLength), "JPEG")) {
-                        lastImage = img;
-                        qDebug() << "Image received successfully, size:" << img.size();
-                        emit imageReceived(img);
-                    } else {
-                        qWarning() << "Failed to load image from received data";
-                        emit errorOccurred("Failed to decode image data");
-                    }
-                    socket->disconnectFromHost();
-                    mode = None;
-                } else {
-                    qDebug() << "Received" << buffer.size() << "of" << contentLength << "bytes";
-                }
-            } else {
-                QImage img;
-                if (img.loadFromData(buffer, "JPEG")) {
-                    lastImage = img;
-                    qDebug() << "Image received (no Content-Length), size:" << img.size();
-                    emit imageReceived(img);
-                    socket->disconnectFromHost();
-                    mode = None;
-                }
+            qDebug() << "Resumed at byte" << first << "of" << total;
+        } else if (code == 200 && parser.header("Content-Type").startsWith("multipart/")) {
+            request->partBoundary = HttpParser::parameter(parser.header("Content-Type"), "boundary");
+            if (request->partBoundary.isEmpty()) {
+                qWarning() << "Multipart response without boundary";
+                finish(request, false, "Invalid server response format");
+                return;
+            }
+            qDebug() << "Receiving progressive scans";
+        } else if (code == 200) {
+            if (!request->body.isEmpty()) {
+                qDebug() << "Image changed on server, restarting download";
+                request->body.clear();
             }
+            request->decoder.reset();
+            request->decodedImage = QImage();
+            request->partialRows = 0;
+            request->contentLength = qMax<qint64>(0, parser.contentLength());
+            request->entityTag = parser.header("ETag").toByteArray();
+            request->rangesAccepted = HttpParser::containsToken(parser.header("Accept-Ranges"), "bytes");
+            qDebug() << "Content-Length:" << request->contentLength;
+        } else {
+            finish(request, false, QString("Server responded with code %1").arg(code));
+            return;
         }
-    } else if (mode == UploadImage) {
-        int headerEnd = buffer.indexOf("\r\n\r\n");
-        if (headerEnd == -1) {
+        request->buffer.remove(0, parser.headerSize());
+        request->headerParsed = true;
+        if (code == 200 && request->partBoundary.isEmpty() && request->connections > 1 && startSegments(request)) {
             return;
         }
-        
-        QByteArray header = buffer.left(headerEnd);
-        QList<QByteArray> lines = header.split('\n');
-        if (!lines.isEmpty()) {
-            QList<QByteArray> statusParts = lines.first().split(' ');
-            if (statusParts.size() >= 2) {
-                bool ok;
-                int code = statusParts[1].trimmed().toInt(&ok);
-                if (ok) {
-                    qDebug() << "Server response code:" << code;
-                    if (code >= 200 && code < 300) {
-                        emit uploadFinished(true, "Upload successful");
-                    } else {
-                        QString errorMsg = QString("Server responded with code %1").arg(code);
-                        qWarning() << errorMsg;
-                        emit uploadFinished(false, errorMsg);
-                    }
-                } else {
-                    qWarning() << "Invalid status code in response";
-                    emit uploadFinished(false, "Invalid server response format");
-                }
-            } else {
-                qWarning() << "Invalid response header format";
-                emit uploadFinished(false, "Invalid server response format");
-            }
-        } else {
-            qWarning() << "Empty response header";
-            emit uploadFinished(false, "Invalid server response");
+    }
+
+    if (!request->partBoundary.isEmpty()) {
+        request->body += request->buffer;
+        request->buffer.clear();
+        processParts(request);
+        return;
+    }
+
+    QByteArray chunk = request->buffer;
+    request->buffer.clear();
+    if (request->contentLength > 0) {
+        chunk.truncate(qMax<qint64>(0, request->contentLength - request->body.size()));
+    }
+    request->body += chunk;
+    request->decoder.setSource(request->body.constData(), request->body.size());
+    if (request->contentLength > 0 && request->body.size() >= request->contentLength) {
+        finishBody(request);
+        return;
+    }
+    if (request->contentLength > 0) {
+        qDebug() << "Received" << request->body.size() << "of" << request->contentLength << "bytes";
+    }
+    decodePartial(request);
+}
+
+void JPEGClient::decodePartial(Request* request) {
+    // Each output pass costs a full IDCT, so decoding only runs when a new
+    // partial image may be shown; the decoder keeps buffering meanwhile.
+    if (request->partialTimer.isValid() && request->partialTimer.elapsed() < PartialImageIntervalMs) {
+        return;
+    }
+    request->partialTimer.start();
+
+    JPEGScanDecoder& decoder = request->decoder;
+    QImage image;
+    JPEGScanDecoder::Status status;
+    bool newScan = false;
+    while ((status = decoder.decodeNextScan(image)) == JPEGScanDecoder::ScanReady) {
+        request->decodedImage = image;
+        newScan = true;
+    }
+    if (status == JPEGScanDecoder::Finished && request->contentLength <= 0) {
+        // No Content-Length: the end of the image marks the end of the body.
+        finishBody(request);
+        return;
+    }
+    if (newScan) {
+        emit partialImageReceived(request->id, request->decodedImage);
+    } else if (status == JPEGScanDecoder::NeedMoreData && decoder.rowsDecoded() > request->partialRows) {
+        request->partialRows = decoder.rowsDecoded();
+        emit partialImageReceived(request->id, decoder.partialImage());
+    }
+}
+
+void JPEGClient::finishBody(Request* request) {
+    JPEGScanDecoder& decoder = request->decoder;
+    decoder.setComplete();
+    QImage image;
+    JPEGScanDecoder::Status status;
+    while ((status = decoder.decodeNextScan(image)) == JPEGScanDecoder::ScanReady) {
+        request->decodedImage = image;
+    }
+    QImage img = request->decodedImage;
+    if (status != JPEGScanDecoder::Finished || img.isNull()) {
+        // Streams the scan decoder rejects (e.g. CMYK) still go through Qt.
+        if (!img.loadFromData(request->body, "JPEG")) {
+            finish(request, false, "Failed to decode image data");
+            return;
         }
-        socket->disconnectFromHost();
-        mode = None;
+    }
+    qDebug() << "Image received successfully, size:" << img.size();
+    const qint64 elapsedMs = qMax<qint64>(1, request->started.elapsed());
+    const QString message = QString("Image received: %1 KB in %2 ms, %3 MB/s over %4 connection(s)")
+        .arg(request->body.size() / 1024)
+        .arg(elapsedMs)
+        .arg(request->body.size() / 1000.0 / elapsedMs, 0, 'f', 2)
+        .arg(qMax(1, int(request->segments.size())));
+    qDebug() << message;
+    if (deliverImage(request, img)) {
+        finish(request, true, message);
     }
 }
 
-void JPEGClient::onError(QAbstractSocket::SocketError error) {
-    if (error == QAbstractSocket::RemoteHostClosedError && mode == UploadImage) {
+// Called once the first connection's 200 response header is in. Splits the
+// body into ranges; the first continues on that connection, the others get
+// connections of their own. Returns false to stay with a single stream.
+bool JPEGClient::startSegments(Request* request) {
+    const int count = int(qMin<qint64>(request->connections, request->contentLength / MinSegmentBytes));
+    if (count < 2) {
+        return false;
+    }
+    if (!request->rangesAccepted || request->entityTag.isEmpty() || request->entityTag.startsWith("W/")) {
+        qDebug() << "Server does not support byte ranges, downloading over one connection";
+        return false;
+    }
+
+    request->body = QByteArray(request->contentLength, Qt::Uninitialized);
+    request->bodyDecoded = 0;
+    for (int i = 0; i < count; ++i) {
+        Segment* segment = new Segment;
+        segment->begin = request->contentLength * i / count;
+        segment->end = request->contentLength * (i + 1) / count;
+        request->segments << segment;
+    }
+    qDebug() << "Downloading" << request->contentLength << "bytes as" << count << "ranges";
+
+    Segment* first = request->segments.first();
+    first->socket = request->socket;
+    first->headerParsed = true;
+    first->buffer = request->buffer;
+    request->socket = nullptr;
+    request->buffer.clear();
+    first->socket->disconnect(this);
+    const int id = request->id;
+    connect(first->socket, &QTcpSocket::readyRead, this, [this, id]() { onSegmentReadyRead(id, 0); });
+    connect(first->socket, &QTcpSocket::errorOccurred, this, [this, id](QAbstractSocket::SocketError error) {
+        onSegmentError(id, 0, error);
+    });
+    for (int i = 1; i < count; ++i) {
+        connectSegment(id, i);
+    }
+    onSegmentReadyRead(id, 0);
+    return true;
+}
+
+void JPEGClient::connectSegment(int requestId, int index) {
+    Request* request = requests.value(requestId);
+    if (!request || index >= request->segments.size()) {
+        return;
+    }
+    Segment* segment = request->segments[index];
+    segment->buffer.clear();
+    segment->parser.reset();
+    segment->headerParsed = false;
+    segment->socket = createSocket();
+    connect(segment->socket, &QTcpSocket::readyRead, this, [this, requestId, index]() { onSegmentReadyRead(requestId, index); });
+    connect(segment->socket, &QTcpSocket::errorOccurred, this, [this, requestId, index](QAbstractSocket::SocketError error) {
+        onSegmentError(requestId, index, error);
+    });
+    startConnection(segment->socket, request->host, request->port, [this, requestId, index]() {
+        sendSegmentRequest(requestId, index);
+    });
+}
+
+void JPEGClient::sendSegmentRequest(int requestId, int index) {
+    Request* request = requests.value(requestId);
+    if (!request || index >= request->segments.size()) {
+        return;
+    }
+    Segment* segment = request->segments[index];
+    const QByteArray header = HttpRequest::imageGet("/", request->host, false, false,
+                                                    segment->begin + segment->received, segment->end - 1,
+                                                    request->entityTag);
+    if (segment->socket->write(header) != header.size()) {
+        finish(request, false, QString("Failed to send request: %1").arg(segment->socket->errorString()));
+    }
+}
+
+void JPEGClient::onSegmentReadyRead(int requestId, int index) {
+    Request* request = requests.value(requestId);
+    if (!request || index >= request->segments.size()) {
+        return;
+    }
+    Segment* segment = request->segments[index];
+    if (!segment->socket) {
+        return;
+    }
+    request->timer->start(IdleTimeoutMs);
+
+    if (!segment->headerParsed) {
+        segment->buffer += segment->socket->readAll();
+        HttpParser::Status status = segment->parser.parse(segment->buffer);
+        if (status == HttpParser::NeedMore) {
+            return;
+        }
+        if (status == HttpParser::Error) {
+            qWarning() << "Malformed range response header:" << segment->parser.errorString();
+            finish(request, false, "Invalid server response format");
+            return;
+        }
+        // A 200 here means If-Range failed: the image changed under us.
+        qint64 first = 0;
+        qint64 last = 0;
+        qint64 total = 0;
+        if (segment->parser.statusCode() != 206
+                || !HttpParser::parseContentRange(segment->parser.header("Content-Range"), first, last, total)
+                || first != segment->begin + segment->received || last != segment->end - 1
+                || total != request->contentLength) {
+            qWarning() << "Unexpected range response:" << segment->parser.statusCode()
+                       << segment->parser.header("Content-Range");
+            finish(request, false, "Image changed on server during segmented download");
+            return;
+        }
+        segment->buffer.remove(0, segment->parser.headerSize());
+        segment->headerParsed = true;
+    }
+
+    // Data that came in with the header, then straight from the socket into place.
+    char* target = request->body.data() + segment->begin;
+    const qint64 length = segment->end - segment->begin;
+    if (!segment->buffer.isEmpty()) {
+        const qint64 n = qMin<qint64>(segment->buffer.size(), length - segment->received);
+        std::memcpy(target + segment->received, segment->buffer.constData(), n);
+        segment->received += n;
+        segment->buffer.clear();
+    }
+    if (segment->received < length) {
+        const qint64 n = segment->socket->read(target + segment->received, length - segment->received);
+        if (n > 0) {
+            segment->received += n;
+        }
+    }
+    if (segment->received == length) {
+        segment->socket->disconnect(this);
+        segment->socket->abort();
+        segment->socket->deleteLater();
+        segment->socket = nullptr;
+    }
+
+    // Feed the decoder the complete prefix of the body.
+    qint64 prefix = 0;
+    bool complete = true;
+    for (const Segment* other : std::as_const(request->segments)) {
+        if (other->received < other->end - other->begin) {
+            prefix = other->begin + other->received;
+            complete = false;
+            break;
+        }
+        prefix = other->end;
+    }
+    if (prefix > request->bodyDecoded) {
+        request->decoder.setSource(request->body.constData(), prefix);
+        request->bodyDecoded = prefix;
+    }
+    if (complete) {
+        finishBody(request);
+    } else {
+        decodePartial(request);
+    }
+}
+
+void JPEGClient::onSegmentError(int requestId, int index, QAbstractSocket::SocketError error) {
+    Request* request = requests.value(requestId);
+    if (!request || index >= request->segments.size()) {
+        return;
+    }
+    Segment* segment = request->segments[index];
+    if (!segment->socket) {
+        return;
+    }
+    const QString err = segment->socket->errorString();
+    segment->socket->disconnect(this);
+    segment->socket->abort();
+    segment->socket->deleteLater();
+    segment->socket = nullptr;
+    if (segment->attempts >= MaxResumeAttempts) {
+        qWarning() << "Socket error:" << error << "-" << err;
+        finish(request, false, QString("Network error: %1").arg(err));
         return;
     }
-    
-    QString err = socket->errorString();
+    ++segment->attempts;
+    qWarning() << "Range" << index << "interrupted at" << segment->received << "of" << segment->end - segment->begin
+               << "bytes:" << err;
+    QTimer::singleShot(ResumeDelayMs * segment->attempts, this, [this, requestId, index]() {
+        connectSegment(requestId, index);
+    });
+}
+
+void JPEGClient::releaseSegments(Request* request) {
+    for (Segment* segment : std::as_const(request->segments)) {
+        if (segment->socket) {
+            segment->socket->disconnect(this);
+            segment->socket->abort();
+            segment->socket->deleteLater();
+        }
+        delete segment;
+    }
+    request->segments.clear();
+}
+
+void JPEGClient::readUploadResponse(Request* request) {
+    HttpParser::Status status = request->responseParser.parse(request->buffer);
+    if (status == HttpParser::NeedMore) {
+        return;
+    }
+    if (status != HttpParser::Done) {
+        qWarning() << "Invalid response header format:" << request->responseParser.errorString();
+        finish(request, false, "Invalid server response format");
+        return;
+    }
+    const int code = request->responseParser.statusCode();
+    qDebug() << "Server response code:" << code;
+    if (code >= 200 && code < 300) {
+        finish(request, true, "Upload successful");
+    } else {
+        finish(request, false, QString("Server responded with code %1").arg(code));
+    }
+}
+
+void JPEGClient::onError(int requestId, QAbstractSocket::SocketError error) {
+    Request* request = requests.value(requestId);
+    if (!request || !request->socket) {
+        return;
+    }
+    // Keep whatever arrived before the connection dropped.
+    if (request->kind == GetImage && request->socket->bytesAvailable() > 0) {
+        onReadyRead(requestId);
+        if (!requests.contains(requestId)) {
+            return;
+        }
+    }
+    // Without Content-Length the body ends when the server closes.
+    if (error == QAbstractSocket::RemoteHostClosedError && request->kind == GetImage && request->headerParsed
+            && request->partBoundary.isEmpty() && request->contentLength <= 0 && !request->body.isEmpty()) {
+        finishBody(request);
+        return;
+    }
+    // A scan stream that already delivered an image just ended early.
+    if (error == QAbstractSocket::RemoteHostClosedError && request->kind == GetImage && request->partsReceived > 0) {
+        finish(request, true, QString("Scan stream ended after %1 images").arg(request->partsReceived));
+        return;
+    }
+    if (canResume(request)) {
+        qWarning() << "Download interrupted at" << request->body.size() << "of" << request->contentLength
+                   << "bytes:" << request->socket->errorString();
+        scheduleResume(request);
+        return;
+    }
+
+    const QString err = request->socket->errorString();
     qWarning() << "Socket error:" << error << "-" << err;
-    
-    if (mode == UploadImage) {
-        emit uploadFinished(false, QString("Network error: %1").arg(err));
-    } else if (mode == GetImage) {
-        emit errorOccurred(QString("Network error: %1").arg(err));
+    if (error == QAbstractSocket::RemoteHostClosedError && request->kind == UploadImage) {
+        finish(request, false, "Connection closed before the server responded");
+    } else {
+        finish(request, false, QString("Network error: %1").arg(err));
+    }
+}
+
+void JPEGClient::onTimeout(int requestId) {
+    Request* request = requests.value(requestId);
+    if (!request) {
+        return;
+    }
+    if (!request->segments.isEmpty()) {
+        finish(request, false, "Timed out waiting for the server");
+        return;
+    }
+    if (!request->socket) {
+        return;
+    }
+    const bool connected = request->connected;
+    if (connected && canResume(request)) {
+        qWarning() << "Download stalled at" << request->body.size() << "of" << request->contentLength << "bytes";
+        scheduleResume(request);
+        return;
+    }
+    finish(request, false, connected ? QString("Timed out waiting for the server")
+                                     : QString("Timed out connecting to %1:%2").arg(request->host).arg(request->port));
+}
+
+void JPEGClient::processParts(Request* request) {
+    const QByteArray delimiter = "--" + request->partBoundary;
+    QByteArray& body = request->body;
+    while (true) {
+        if (request->partLength < 0) {
+            const int pos = body.indexOf(delimiter);
+            if (pos < 0) {
+                // Keep a possible partial delimiter at the end.
+                body.remove(0, qMax<qsizetype>(0, body.size() - delimiter.size()));
+                return;
+            }
+            const int lineEnd = body.indexOf('\n', pos);
+            if (lineEnd < 0) {
+                return;
+            }
+            if (body.mid(pos + delimiter.size(), 2) == "--") {
+                qDebug() << "Scan stream complete," << request->partsReceived << "images";
+                finish(request, true, QString("Received %1 scans").arg(request->partsReceived));
+                return;
+            }
+            HttpParser& partParser = request->partParser;
+            partParser.reset();
+            const HttpParser::Status status = partParser.parse(body.constData() + lineEnd + 1, body.size() - lineEnd - 1);
+            if (status == HttpParser::NeedMore) {
+                return;
+            }
+            if (status == HttpParser::Error || partParser.contentLength() < 0) {
+                qWarning() << "Malformed multipart part:" << partParser.errorString();
+                finish(request, false, "Invalid server response format");
+                return;
+            }
+            request->partLength = partParser.contentLength();
+            body.remove(0, lineEnd + 1 + partParser.headerSize());
+        }
+
+        if (body.size() < request->partLength) {
+            return;
+        }
+        QImage img;
+        const bool decoded = img.loadFromData(body.left(request->partLength), "JPEG");
+        body.remove(0, request->partLength);
+        request->partLength = -1;
+        if (!decoded) {
+            qWarning() << "Failed to decode multipart image";
+            continue;
+        }
+        ++request->partsReceived;
+        qDebug() << "Scan" << request->partsReceived << "received, size:" << img.size();
+        if (!deliverImage(request, img)) {
+            return;
+        }
+    }
+}
+
+// False if a receiver aborted the request in response.
+bool JPEGClient::deliverImage(Request* request, const QImage& image) {
+    const int id = request->id;
+    lastImage = image;
+    emit imageReceived(id, image);
+    return requests.contains(id);
+}
+
+void JPEGClient::finish(Request* request, bool success, const QString& message) {
+    const int id = request->id;
+    const RequestKind kind = request->kind;
+    requests.remove(id);
+    releaseSocket(request);
+    releaseSegments(request);
+    request->timer->stop();
+    request->timer->deleteLater();
+    delete request;
+
+    if (!success) {
+        qWarning() << "Request" << id << "failed:" << message;
+    }
+    if (kind == UploadImage) {
+        emit uploadFinished(id, success, message);
+    } else {
+        emit downloadFinished(id, success, message);
     }
-    mode = None;
 }
 
 QImage JPEGClient::getLastImage() const {
@@ -3,31 +3,150 @@
 
 #include <QtNetwork/QTcpSocket>
 #include <QObject>
+#include <QHash>
+#include <QElapsedTimer>
+#include <QFile>
 #include <QImage>
+#include <QList>
+#include <functional>
+#include "httpparser.h"
+#include "jpegscandecoder.h"
 
+class QTimer;
+
+// Fully asynchronous: every request runs on its own socket, driven by
+// socket signals, with timers for the timeouts. Any number of requests may
+// be in flight; each reports through the signals carrying its id, and
+// finishes with exactly one downloadFinished or uploadFinished.
+// Works on plain QTcpSockets; subclasses supply other sockets (e.g. TLS)
+// through createSocket() and startConnection().
 class JPEGClient : public QObject {
     Q_OBJECT
 public:
     explicit JPEGClient(QObject* parent = nullptr);
-    void getImage(const QString& host, quint16 port);
-    void uploadImage(const QString& host, quint16 port, const QString& filename);
+    ~JPEGClient();
+    // Both return the new request's id. With connections > 1, a large image
+    // whose server accepts byte ranges is fetched as that many ranges in
+    // parallel; otherwise it arrives over a single stream.
+    int getImage(const QString& host, quint16 port, int connections = 1);
+    int uploadImage(const QString& host, quint16 port, const QString& filename);
+    void abort(int requestId);
+    int pendingRequests() const { return requests.size(); }
     QImage getLastImage() const;
 signals:
-    void imageReceived(const QImage& image);
-    void errorOccurred(const QString& error);
-    void uploadFinished(bool success, const QString& message);
-private slots:
-    void onReadyRead();
-    void onError(QAbstractSocket::SocketError);
+    // Once per image; a progressive scan stream delivers several.
+    void imageReceived(int requestId, const QImage& image);
+    // While a single image downloads: its top rows (baseline) or newest
+    // complete scan (progressive), at most every PartialImageIntervalMs.
+    void partialImageReceived(int requestId, const QImage& image);
+    void downloadFinished(int requestId, bool success, const QString& message);
+    // Body bytes handed to the network so far, out of total.
+    void uploadProgress(int requestId, qint64 sent, qint64 total);
+    void uploadFinished(int requestId, bool success, const QString& message);
+protected:
+    // New socket owned by the client.
+    virtual QTcpSocket* createSocket();
+    // Connects the socket and calls ready once requests may be written.
+    virtual void startConnection(QTcpSocket* socket, const QString& host, quint16 port,
+                                 const std::function<void()>& ready);
 private:
-    QTcpSocket* socket;
-    QByteArray buffer;
+    enum RequestKind { GetImage, UploadImage };
+    // One byte range [begin, end) of a segmented download.
+    struct Segment {
+        QTcpSocket* socket = nullptr;
+        qint64 begin = 0;
+        qint64 end = 0;
+        qint64 received = 0;
+        QByteArray buffer;
+        HttpParser parser{HttpParser::Response};
+        bool headerParsed = false;
+        int attempts = 0;
+    };
+    struct Request {
+        int id = 0;
+        RequestKind kind = GetImage;
+        QString host;
+        quint16 port = 0;
+        QTcpSocket* socket = nullptr;
+        bool connected = false;
+        QTimer* timer = nullptr;
+        QByteArray buffer;
+        QByteArray body;
+        QByteArray entityTag;
+        bool rangesAccepted = false;
+        int resumeAttempts = 0;
+        bool headerParsed = false;
+        qint64 contentLength = 0;
+        HttpParser responseParser{HttpParser::Response};
+        // multipart/x-mixed-replace responses: one image per part.
+        QByteArray partBoundary;
+        HttpParser partParser{HttpParser::Fields};
+        qint64 partLength = -1;
+        int partsReceived = 0;
+        // Uploads stream from the file a chunk at a time.
+        QFile uploadFile;
+        qint64 uploadTotal = 0;
+        qint64 uploadSent = 0;
+        qint64 uploadHeaderBytes = 0;
+        qint64 socketBytesWritten = 0;
+        // Single-image bodies are decoded as they arrive, straight from body.
+        JPEGScanDecoder decoder;
+        QImage decodedImage;
+        int partialRows = 0;
+        QElapsedTimer partialTimer;
+        // Segmented downloads write every range straight into a body
+        // preallocated to Content-Length; the decoder reads the complete
+        // prefix of it in place.
+        int connections = 1;
+        QList<Segment*> segments;
+        qint64 bodyDecoded = 0;
+        QElapsedTimer started;
+    };
+
+    Request* createRequest(RequestKind kind, const QString& host, quint16 port);
+    void failLater(Request* request, const QString& message);
+    void connectSocket(Request* request);
+    void onConnected(int requestId);
+    void onReadyRead(int requestId);
+    void onBytesWritten(int requestId, qint64 bytes);
+    void onError(int requestId, QAbstractSocket::SocketError error);
+    void onTimeout(int requestId);
+    void sendGetRequest(Request* request);
+    void sendUploadRequest(Request* request);
+    void writeUploadChunk(Request* request);
+    void readGetResponse(Request* request);
+    void readUploadResponse(Request* request);
+    bool canResume(const Request* request) const;
+    void scheduleResume(Request* request);
+    void resumeDownload(int requestId);
+    bool startSegments(Request* request);
+    void connectSegment(int requestId, int index);
+    void sendSegmentRequest(int requestId, int index);
+    void onSegmentReadyRead(int requestId, int index);
+    void onSegmentError(int requestId, int index, QAbstractSocket::SocketError error);
+    void releaseSegments(Request* request);
+    void processParts(Request* request);
+    void decodePartial(Request* request);
+    void finishBody(Request* request);
+    bool deliverImage(Request* request, const QImage& image);
+    void finish(Request* request, bool success, const QString& message);
+    void releaseSocket(Request* request);
+
+    QHash<int, Request*> requests;
+    int nextRequestId;
     QImage lastImage;
-    bool headerParsed;
-    int contentLength;
-    enum OperationMode { None, GetImage, UploadImage };
-    OperationMode mode;
-    QByteArray uploadBuffer;
+
+    static const int MaxResumeAttempts = 5;
+    static const int ResumeDelayMs = 500;
+    static const int ConnectTimeoutMs = 5000;
+    // Longest silence, in either direction, once connected.
+    static const int IdleTimeoutMs = 10000;
+    static const int PartialImageIntervalMs = 200;
+    // Upload data queued in the socket is kept below this.
+    static const qint64 UploadChunkSize = 64 * 1024;
+    // Smaller ranges are not worth a connection of their own.
+    static const qint64 MinSegmentBytes = 1024 * 1024;
+    static const int MaxConnections = 16;
 };
 
 #endif // JPEGCLIENT_H
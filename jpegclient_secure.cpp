@@ -1,182 +1,61 @@
 #include "jpegclient_secure.h"
-#include <QHostAddress>
-#include <QBuffer>
-#include <QImageReader>
-#include <QFile>
+#include <QSslConfiguration>
+#include <QElapsedTimer>
 #include <QDebug>
 
-JPEGSslClient::JPEGSslClient(QObject* parent)
-    : QObject(parent), socket(new QSslSocket(this)), headerParsed(false), contentLength(0), mode(None) {
-    connect(socket, &QSslSocket::readyRead, this, &JPEGSslClient::onReadyRead);
-    connect(socket, &QSslSocket::encrypted, this, &JPEGSslClient::onEncrypted);
-    connect(socket, QOverload<const QList<QSslError>&>::of(&QSslSocket::sslErrors),
-            this, &JPEGSslClient::onSslErrors);
-    connect(socket, QOverload<QAbstractSocket::SocketError>::of(&QSslSocket::errorOccurred),
-            this, &JPEGSslClient::onError);
-    connect(socket, &QSslSocket::connected, [this]() {
-        qDebug() << "Connected to secure server";
-    });
-    connect(socket, &QSslSocket::disconnected, [this]() {
-        qDebug() << "Disconnected from secure server";
-    });
-}
-
-void JPEGSslClient::getImage(const QString& host, quint16 port) {
-    // Валидация входных данных
-    if (host.isEmpty()) {
-        emit errorOccurred("Host address is empty");
-        return;
-    }
-    if (port == 0 || port > 65535) {
-        emit errorOccurred("Invalid port number");
-        return;
-    }
-
-    buffer.clear();
-    headerParsed = false;
-    contentLength = 0;
-    uploadBuffer.clear();
-    mode = GetImage;
-
-    qDebug() << "Connecting to secure server" << host << ":" << port;
-    socket->abort();
-
-    socket->connectToHostEncrypted(host, port);
-    socket->ignoreSslErrors();
-    
-    if (!socket->waitForEncrypted(5000)) {
-        QString errorMsg = QString("SSL connection failed: %1").arg(socket->errorString());
-        qWarning() << errorMsg;
-        emit errorOccurred(errorMsg);
-        mode = None;
-        return;
-    }
+namespace {
 
-    QByteArray request = "GET / HTTP/1.1\r\n"
-                        "Host: " + host.toUtf8() + "\r\n"
-                        "Connection: close\r\n"
-                        "\r\n";
-    
-    qint64 written = socket->write(request);
-    if (written != request.size()) {
-        QString errorMsg = QString("Failed to send request: %1").arg(socket->errorString());
-        qWarning() << errorMsg;
-        emit errorOccurred(errorMsg);
-        socket->disconnectFromHost();
-        mode = None;
-        return;
+// Reads one DER tag and length at pos; false if it does not fit in data.
+bool readDer(const QByteArray& data, qsizetype& pos, uchar& tag, qsizetype& length) {
+    if (pos + 2 > data.size()) {
+        return false;
     }
-
-    if (!socket->waitForBytesWritten(3000)) {
-        QString errorMsg = QString("Write timeout: %1").arg(socket->errorString());
-        qWarning() << errorMsg;
-        emit errorOccurred(errorMsg);
-        socket->disconnectFromHost();
-        mode = None;
-        return;
+    tag = uchar(data[pos++]);
+    length = uchar(data[pos++]);
+    if (length & 0x80) {
+        const int bytes = length & 0x7f;
+        if (bytes == 0 || bytes > 4 || pos + bytes > data.size()) {
+            return false;
+        }
+        length = 0;
+        for (int i = 0; i < bytes; ++i) {
+            length = (length << 8) | uchar(data[pos++]);
+        }
     }
-
-    qDebug() << "GET request sent to secure server, waiting for response";
+    return length <= data.size() - pos;
 }
 
-void JPEGSslClient::uploadImage(const QString& host, quint16 port, const QString& filename) {
-    if (host.isEmpty()) {
-        emit uploadFinished(false, "Host address is empty");
-        return;
-    }
-    if (port == 0 || port > 65535) {
-        emit uploadFinished(false, "Invalid port number");
-        return;
-    }
-
-    QFile file(filename);
-    if (!file.exists()) {
-        emit uploadFinished(false, "File does not exist: " + filename);
-        return;
-    }
-    if (!file.open(QIODevice::ReadOnly)) {
-        emit uploadFinished(false, "Unable to open file for reading: " + filename);
-        return;
-    }
-    
-    QByteArray data = file.readAll();
-    file.close();
-
-    if (data.isEmpty()) {
-        emit uploadFinished(false, "File is empty: " + filename);
-        return;
-    }
-
-    buffer.clear();
-    headerParsed = false;
-    contentLength = 0;
-    uploadBuffer = data;
-    mode = UploadImage;
-
-    qDebug() << "Uploading" << filename << "(" << data.size() << "bytes) to secure server" << host << ":" << port;
-    socket->abort();
-    socket->ignoreSslErrors();
-    socket->connectToHostEncrypted(host, port);
-    
-    if (!socket->waitForEncrypted(10000)) {
-        mode = None;
-        QString errorMsg = QString("SSL connection failed: %1").arg(socket->errorString());
-        qWarning() << errorMsg;
-        emit uploadFinished(false, errorMsg);
-        return;
-    }
-
-    QByteArray request;
-    request += "POST / HTTP/1.1\r\n";
-    request += "Host: " + host.toUtf8() + "\r\n";
-    request += "Content-Type: image/jpeg\r\n";
-    request += "Content-Length: " + QByteArray::number(uploadBuffer.size()) + "\r\n";
-    request += "Connection: close\r\n";
-    request += "\r\n";
-    
-    qint64 written = socket->write(request);
-    if (written != request.size()) {
-        mode = None;
-        QString errorMsg = QString("Write header failed: %1").arg(socket->errorString());
-        qWarning() << errorMsg;
-        emit uploadFinished(false, errorMsg);
-        socket->disconnectFromHost();
-        return;
-    }
-    
-    if (!socket->waitForBytesWritten(5000)) {
-        mode = None;
-        QString errorMsg = QString("Write timeout (header): %1").arg(socket->errorString());
-        qWarning() << errorMsg;
-        emit uploadFinished(false, errorMsg);
-        socket->disconnectFromHost();
-        return;
-    }
-
-    written = socket->write(uploadBuffer);
-    if (written != uploadBuffer.size()) {
-        mode = None;
-        QString errorMsg = QString("Write body failed: %1").arg(socket->errorString());
-        qWarning() << errorMsg;
-        emit uploadFinished(false, errorMsg);
-        socket->disconnectFromHost();
-        return;
-    }
-    
-    if (!socket->waitForBytesWritten(10000)) {
-        mode = None;
-        QString errorMsg = QString("Write timeout (body): %1").arg(socket->errorString());
-        qWarning() << errorMsg;
-        emit uploadFinished(false, errorMsg);
-        socket->disconnectFromHost();
-        return;
+// Session ID of an OpenSSL session as serialized by sessionTicket():
+// SEQUENCE { version, ssl_version, cipher, session_id, ... }.
+QByteArray sessionId(const QByteArray& session) {
+    qsizetype pos = 0;
+    uchar tag = 0;
+    qsizetype length = 0;
+    if (!readDer(session, pos, tag, length) || tag != 0x30) {
+        return QByteArray();
+    }
+    for (int field = 0; field < 4; ++field) {
+        if (!readDer(session, pos, tag, length)) {
+            return QByteArray();
+        }
+        if (field == 3) {
+            return tag == 0x04 ? session.mid(pos, length) : QByteArray();
+        }
+        pos += length;
     }
+    return QByteArray();
+}
 
-    qDebug() << "Upload data sent to secure server, waiting for response";
 }
 
-void JPEGSslClient::onEncrypted() {
-    qDebug() << "SSL encryption established";
+JPEGSslClient::JPEGSslClient(QObject* parent)
+    : JPEGClient(parent) {}
+
+QTcpSocket* JPEGSslClient::createSocket() {
+    QSslSocket* socket = new QSslSocket(this);
+    connect(socket, QOverload<const QList<QSslError>&>::of(&QSslSocket::sslErrors),
+            this, &JPEGSslClient::onSslErrors);
+    return socket;
 }
 
 void JPEGSslClient::onSslErrors(const QList<QSslError>& errors) {
@@ -186,116 +65,60 @@ void JPEGSslClient::onSslErrors(const QList<QSslError>& errors) {
     }
 }
 
-void JPEGSslClient::onReadyRead() {
-    buffer += socket->readAll();
-
-    if (mode == GetImage) {
-        if (!headerParsed) {
-            int headerEnd = buffer.indexOf("\r\n\r\n");
-            if (headerEnd != -1) {
-                QByteArray header = buffer.left(headerEnd);
-                buffer = buffer.mid(headerEnd + 4);
-                QList<QByteArray> lines = header.split('\n');
-                for (const QByteArray& line : lines) {
-                    QByteArray trimmedLine = line.trimmed();
-                    if (trimmedLine.toLower().startsWith("content-length:")) {
-                        bool ok;
-                        contentLength = trimmedLine.mid(15).trimmed().toInt(&ok);
-                        if (!ok) {
-                            contentLength = 0;
-                        }
-                        qDebug() << "Content-Length:" << contentLength;
-                    }
-                }
-                headerParsed = true;
-            } else {
-                return;
-            }
-        }
-        
-        if (headerParsed) {
-            if (contentLength > 0) {
-                if (buffer.size() >= contentLength) {
-                    QImage img;
-                    if (img.loadFromData(buffer.left(contentLength), "JPEG")) {
-                        lastImage = img;
-                        qDebug() << "Image received successfully from secure server, size:" << img.size();
-                        emit imageReceived(img);
-                    } else {
-                        qWarning() << "Failed to load image from received data";
-                        emit errorOccurred("Failed to decode image data");
-                    }
-                    socket->disconnectFromHost();
-                    mode = None;
-                } else {
-                    qDebug() << "Received" << buffer.size() << "of" << contentLength << "bytes";
-                }
-            } else {
-                QImage img;
-                if (img.loadFromData(buffer, "JPEG")) {
-                    lastImage = img;
-                    qDebug() << "Image received (no Content-Length), size:" << img.size();
-                    emit imageReceived(img);
-                    socket->disconnectFromHost();
-                    mode = None;
-                }
+void JPEGSslClient::startConnection(QTcpSocket* tcpSocket, const QString& host, quint16 port,
+                                    const std::function<void()>& ready) {
+    QSslSocket* socket = static_cast<QSslSocket*>(tcpSocket);
+    const QString key = host + ':' + QString::number(port);
+    QSslConfiguration config = socket->sslConfiguration();
+    // Persistence makes sessionTicket() return the session after the handshake.
+    config.setSslOption(QSsl::SslOptionDisableSessionPersistence, false);
+    config.setSslOption(QSsl::SslOptionDisableSessionTickets, false);
+    const QByteArray offered = sessions.value(key);
+    if (!offered.isEmpty()) {
+        config.setSessionTicket(offered);
+    }
+    socket->setSslConfiguration(config);
+
+    QElapsedTimer setupTimer;
+    setupTimer.start();
+    connect(socket, &QSslSocket::encrypted, this, [this, socket, key, offered, setupTimer]() {
+        const qint64 us = setupTimer.nsecsElapsed() / 1000;
+        const QByteArray session = socket->sslConfiguration().sessionTicket();
+        const char* outcome = "full handshake";
+        ++stats.handshakes;
+        if (offered.isEmpty()) {
+            stats.fullSetupUs += us;
+        } else if (socket->sessionProtocol() == QSsl::TlsV1_3) {
+            ++stats.sessionsOffered;
+            ++stats.tls13Offered;
+            stats.offeredSetupUs += us;
+            outcome = "session offered (TLS 1.3, resumption unknown)";
+        } else {
+            ++stats.sessionsOffered;
+            stats.offeredSetupUs += us;
+            outcome = "session not resumed";
+            const QByteArray id = sessionId(session);
+            if (!id.isEmpty() && id == sessionId(offered)) {
+                ++stats.sessionsResumed;
+                outcome = "session resumed";
             }
         }
-    } else if (mode == UploadImage) {
-        int headerEnd = buffer.indexOf("\r\n\r\n");
-        if (headerEnd == -1) {
-            return;
+        if (!session.isEmpty()) {
+            sessions.insert(key, session);
         }
-        
-        QByteArray header = buffer.left(headerEnd);
-        QList<QByteArray> lines = header.split('\n');
-        if (!lines.isEmpty()) {
-            QList<QByteArray> statusParts = lines.first().split(' ');
-            if (statusParts.size() >= 2) {
-                bool ok;
-                int code = statusParts[1].trimmed().toInt(&ok);
-                if (ok) {
-                    qDebug() << "Secure server response code:" << code;
-                    if (code >= 200 && code < 300) {
-                        emit uploadFinished(true, "Upload successful");
-                    } else {
-                        QString errorMsg = QString("Server responded with code %1").arg(code);
-                        qWarning() << errorMsg;
-                        emit uploadFinished(false, errorMsg);
-                    }
-                } else {
-                    qWarning() << "Invalid status code in response";
-                    emit uploadFinished(false, "Invalid server response format");
-                }
-            } else {
-                qWarning() << "Invalid response header format";
-                emit uploadFinished(false, "Invalid server response format");
-            }
-        } else {
-            qWarning() << "Empty response header";
-            emit uploadFinished(false, "Invalid server response");
+        qDebug() << "TLS connection to" << key << "set up in" << us / 1000.0 << "ms," << outcome << ";"
+                 << "resumed" << stats.sessionsResumed << "of" << stats.sessionsOffered - stats.tls13Offered
+                 << "TLS 1.2 offers;" << stats.tls13Offered << "TLS 1.3 offers";
+    });
+    connect(socket, &QSslSocket::encrypted, this, ready);
+    // TLS 1.3 tickets arrive after the handshake.
+    connect(socket, &QSslSocket::newSessionTicketReceived, this, [this, socket, key]() {
+        const QByteArray session = socket->sslConfiguration().sessionTicket();
+        if (!session.isEmpty()) {
+            sessions.insert(key, session);
         }
-        socket->disconnectFromHost();
-        mode = None;
-    }
-}
-
-void JPEGSslClient::onError(QAbstractSocket::SocketError error) {
-    if (error == QAbstractSocket::RemoteHostClosedError && mode == UploadImage) {
-        return;
-    }
-    
-    QString err = socket->errorString();
-    qWarning() << "Socket error:" << error << "-" << err;
-    
-    if (mode == UploadImage) {
-        emit uploadFinished(false, QString("Network error: %1").arg(err));
-    } else if (mode == GetImage) {
-        emit errorOccurred(QString("Network error: %1").arg(err));
-    }
-    mode = None;
-}
+    });
 
-QImage JPEGSslClient::getLastImage() const {
-    return lastImage;
+    socket->ignoreSslErrors();
+    socket->connectToHostEncrypted(host, port);
 }
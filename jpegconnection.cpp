@@ -0,0 +1,681 @@
+#include "jpegconnection.h"
+#include "jpegservice.h"
+#include "filesender.h"
+#include "jpegencoder.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QDir>
+#include <QImage>
+#include <QImageReader>
+#include <QTemporaryFile>
+#include <QUrlQuery>
+#include <QMutexLocker>
+#include <QDebug>
+
+#ifndef Q_OS_WIN
+#include <stdio.h>
+#endif
+
+JPEGConnection::JPEGConnection(QTcpSocket* socket, JPEGService* service, int worker)
+    : QObject(socket), socket(socket), service(service), strategy(service->threadStrategy(worker)),
+      worker(worker), requestParser(HttpParser::Request, MaxHeaderSize), uploadFile(nullptr), uploadExpected(0), uploadReceived(0),
+      scanStrategy(nullptr), scanIndex(0), scanDecoded(0), scanTotal(0), scanWaiting(false),
+      requestCount(0), keepAlive(false), busy(false), closing(false), inProcessLoop(false), requestDeadline(false),
+      requestMethod(ServerMetrics::OtherMethod), parseNsecs(0) {
+    // Bounded so a fast uploader is throttled by TCP instead of by our RAM.
+    socket->setReadBufferSize(UploadChunkSize * 4);
+    idleTimer.setSingleShot(true);
+    connect(&idleTimer, &QTimer::timeout, this, &JPEGConnection::onIdleTimeout);
+    connect(socket, &QTcpSocket::readyRead, this, &JPEGConnection::onReadyRead);
+    connect(socket, &QTcpSocket::disconnected, this, &JPEGConnection::onDisconnected);
+    connect(socket, &QTcpSocket::bytesWritten, this, &JPEGConnection::onBytesWritten);
+    connect(socket, QOverload<QAbstractSocket::SocketError>::of(&QTcpSocket::errorOccurred),
+            this, [this](QAbstractSocket::SocketError error) {
+        if (error != QAbstractSocket::RemoteHostClosedError) {
+            qWarning() << "Socket error:" << error << this->socket->errorString();
+        }
+    });
+    service->metrics().connectionOpened(worker);
+    startTimeout();
+}
+
+JPEGConnection::~JPEGConnection() {
+    delete scanStrategy;
+    service->metrics().connectionClosed(worker);
+    service->release(worker);
+}
+
+void JPEGConnection::onReadyRead() {
+    processBuffer();
+}
+
+void JPEGConnection::onIdleTimeout() {
+    qDebug() << "Closing idle connection after" << requestCount << "requests";
+    closing = true;
+    socket->disconnectFromHost();
+}
+
+void JPEGConnection::onDisconnected() {
+    idleTimer.stop();
+    closing = true;
+    socket->deleteLater();
+}
+
+void JPEGConnection::processBuffer() {
+    if (closing) {
+        return;
+    }
+    inProcessLoop = true;
+    // Pipelined requests are handled one at a time; while a response is
+    // still being sent, new bytes stay in the socket until it completes.
+    while (!busy && !closing) {
+        if (uploadFile) {
+            if (!receiveUpload()) {
+                break;
+            }
+            continue;
+        }
+        const QByteArray incoming = socket->readAll();
+        service->metrics().addBytesIn(worker, incoming.size());
+        buffer.append(incoming);
+        if (buffer.isEmpty() || !handleNextRequest()) {
+            break;
+        }
+    }
+    inProcessLoop = false;
+    if (!busy && !closing) {
+        startTimeout();
+    }
+}
+
+// Keep-alive only governs the wait between requests. A request gets the
+// request timeout once, from its first byte (or the connection opening) until
+// its response starts; later bytes do not extend it, so a client trickling
+// bytes cannot hold the connection open.
+void JPEGConnection::startTimeout() {
+    const bool betweenRequests = requestCount > 0 && buffer.isEmpty() && !uploadFile;
+    if (betweenRequests) {
+        idleTimer.start(qMax(1000, service->keepAliveTimeout()));
+    } else if (!requestDeadline) {
+        requestDeadline = true;
+        idleTimer.start(service->requestTimeout());
+    }
+}
+
+bool JPEGConnection::handleNextRequest() {
+    QElapsedTimer parseTimer;
+    parseTimer.start();
+    const HttpParser::Status status = requestParser.parse(buffer);
+    parseNsecs += parseTimer.nsecsElapsed();
+    if (status == HttpParser::NeedMore) {
+        return false;
+    }
+    service->metrics().observe(worker, ServerMetrics::Parse, parseNsecs);
+    parseNsecs = 0;
+    if (status == HttpParser::Error) {
+        requestMethod = ServerMetrics::OtherMethod;
+        keepAlive = false;
+        buffer.clear();
+        qWarning() << "Malformed request:" << requestParser.errorString();
+        sendResponse(requestParser.headerTooLarge() ? "431 Request Header Fields Too Large" : "400 Bad Request");
+        requestParser.reset();
+        return true;
+    }
+
+    keepAlive = requestParser.keepAlive();
+    if (service->keepAliveTimeout() <= 0 || requestCount + 1 >= service->maxRequestsPerConnection()) {
+        keepAlive = false;
+    }
+
+    qDebug() << "Incoming request:" << requestParser.method() << requestParser.target();
+    requestMethod = ServerMetrics::method(requestParser.method());
+    const bool isGet = requestParser.method() == "GET";
+    const bool isPost = requestParser.method() == "POST";
+    const qint64 contentLength = requestParser.contentLength();
+    const bool chunked = !requestParser.header("Transfer-Encoding").isEmpty();
+    const QByteArray target = requestParser.target().toByteArray();
+    const QByteArray range = requestParser.header("Range").toByteArray();
+    const QByteArray ifRange = requestParser.header("If-Range").toByteArray();
+    const bool acceptsScans = requestParser.header("Accept").toByteArray().contains("multipart/x-mixed-replace");
+    // The parser's views point into buffer; read everything needed first.
+    buffer.remove(0, requestParser.headerSize());
+    requestParser.reset();
+
+    // Only POST bodies are read; any other body would be parsed as the next
+    // pipelined request.
+    if (!isPost && (contentLength > 0 || chunked)) {
+        keepAlive = false;
+        buffer.clear();
+        sendResponse("400 Bad Request");
+        qWarning() << "Request body not allowed for this method";
+        return true;
+    }
+
+    if (isGet) {
+        handleGet(target, range, ifRange, acceptsScans);
+        return true;
+    }
+
+    if (isPost) {
+        if (contentLength <= 0) {
+            keepAlive = false;
+            buffer.clear();
+            sendResponse("400 Bad Request");
+            qWarning() << "Invalid or missing Content-Length in POST request";
+            return true;
+        }
+
+        if (contentLength > service->maxUploadSize()) {
+            keepAlive = false;
+            buffer.clear();
+            sendResponse("413 Payload Too Large");
+            qWarning() << "POST body too large:" << contentLength << "bytes, limit" << service->maxUploadSize();
+            return true;
+        }
+
+        const QString uploadPath = service->uploadPath(target);
+        if (uploadPath.isEmpty()) {
+            keepAlive = false;
+            buffer.clear();
+            sendResponse("404 Not Found");
+            qWarning() << "No upload destination for request target:" << target;
+            return true;
+        }
+
+        if (!beginUpload(contentLength, uploadPath)) {
+            keepAlive = false;
+            buffer.clear();
+            sendResponse("500 Internal Server Error");
+        }
+        return true;
+    }
+
+    keepAlive = false;
+    buffer.clear();
+    sendResponse("400 Bad Request");
+    qWarning() << "Unknown HTTP method in request";
+    return true;
+}
+
+namespace {
+
+const int MaxVariantDimension = 16384;
+
+// Strong validator for one representation of a file: encoded output is
+// deterministic for a given file version and strategy.
+QByteArray entityTag(const QString& path, const QString& variant) {
+    const QFileInfo info(path);
+    return '"' + QByteArray::number(info.size(), 16) + '-'
+         + QByteArray::number(info.lastModified().toMSecsSinceEpoch(), 16) + '-'
+         + variant.toLatin1() + '"';
+}
+
+// Optional ?w=&h=&q= parameters; all absent means the original image.
+struct ImageVariant {
+    int width = 0;
+    int height = 0;
+    int quality = -1;
+
+    bool isOriginal() const { return width == 0 && height == 0 && quality < 0; }
+    QString name() const { return QString("w%1h%2q%3").arg(width).arg(height).arg(quality); }
+};
+
+// Absent parameters keep their default; present ones must be in range.
+bool queryInt(const QUrlQuery& params, const QString& name, int min, int max, int& value) {
+    if (!params.hasQueryItem(name)) {
+        return true;
+    }
+    bool ok = false;
+    const int parsed = params.queryItemValue(name).toInt(&ok);
+    if (!ok || parsed < min || parsed > max) {
+        return false;
+    }
+    value = parsed;
+    return true;
+}
+
+bool parseVariant(const QByteArray& target, ImageVariant& variant) {
+    const int query = target.indexOf('?');
+    if (query < 0) {
+        return true;
+    }
+    const QUrlQuery params(QString::fromLatin1(target.mid(query + 1)));
+    return queryInt(params, "w", 1, MaxVariantDimension, variant.width)
+        && queryInt(params, "h", 1, MaxVariantDimension, variant.height)
+        && queryInt(params, "q", 1, 100, variant.quality);
+}
+
+}
+
+void JPEGConnection::handleGet(const QByteArray& target, const QByteArray& range, const QByteArray& ifRange,
+                               bool acceptsScans) {
+    if (target == "/metrics") {
+        sendResponse("200 OK", service->metrics().render(service->cache(), service->variantCache()),
+                     "text/plain; version=0.0.4; charset=utf-8");
+        return;
+    }
+
+    const QString imagePath = service->resolveImage(target);
+    if (imagePath.isEmpty()) {
+        qWarning() << "No image for request target:" << target;
+        sendResponse("404 Not Found");
+        return;
+    }
+
+    ImageVariant variant;
+    if (!parseVariant(target, variant)) {
+        qWarning() << "Invalid variant parameters:" << target;
+        sendResponse("400 Bad Request");
+        return;
+    }
+
+    qint64 first = 0;
+    qint64 last = 0;
+    QByteArray status;
+    QByteArray headers;
+
+    if (variant.isOriginal() && service->passthroughEnabled() && dynamic_cast<StandardJPEGStrategy*>(strategy)
+            && service->isPassthroughValid(imagePath)) {
+        const qint64 fileSize = QFileInfo(imagePath).size();
+        if (!selectRange(range, ifRange, entityTag(imagePath, "raw"), fileSize, first, last, status, headers)) {
+            return;
+        }
+        const qint64 length = last - first + 1;
+        beginResponse(status);
+        socket->write(responseHeaders(status, length, "image/jpeg", headers));
+        busy = true;
+        FileSender* sender = new FileSender(socket, imagePath, first, length, this);
+        connect(sender, &FileSender::finished, this, [this, sender, first, length](bool success) {
+            service->metrics().addBytesOut(worker, sender->bytesSentDirectly());
+            if (success) {
+                qDebug() << "Sent image passthrough, offset:" << first << "size:" << length;
+            } else {
+                qWarning() << "Passthrough send failed";
+                keepAlive = false;
+            }
+            sender->deleteLater();
+            finishResponse();
+        });
+        sender->start();
+        return;
+    }
+
+    if (!strategy) {
+        sendResponse("500 Internal Server Error");
+        return;
+    }
+    if (acceptsScans && variant.isOriginal() && dynamic_cast<ProgressiveJPEGStrategy*>(strategy)) {
+        beginScanStream(imagePath);
+        return;
+    }
+    // Variants live in their own cache so thumbnails do not evict full images.
+    const QString representation = variant.isOriginal() ? strategy->name() : strategy->name() + '-' + variant.name();
+    ResponseCache& responseCache = variant.isOriginal() ? service->cache() : service->variantCache();
+    const QString cacheKey = ResponseCache::makeKey(imagePath, representation);
+    QByteArray ba;
+    if (responseCache.lookup(cacheKey, ba)) {
+        qDebug() << "Sent image response from cache, size:" << ba.size()
+                 << "hits:" << responseCache.hits() << "misses:" << responseCache.misses();
+    } else {
+        // Resized variants decode straight to the requested box (aspect kept,
+        // never upscaled) instead of decoding the full image first.
+        QImage image;
+        const bool resized = variant.width > 0 || variant.height > 0;
+        QElapsedTimer decodeTimer;
+        decodeTimer.start();
+        const bool loaded = resized
+            ? strategy->loadImageScaled(imagePath, QSize(variant.width, variant.height), image)
+            : strategy->loadImage(imagePath, image);
+        service->metrics().observe(worker, ServerMetrics::Decode, decodeTimer.nsecsElapsed());
+        if (!loaded) {
+            qWarning() << "Image not found or failed to load:" << imagePath;
+            sendResponse("404 Not Found");
+            return;
+        }
+        if (!encodeImage(image, variant.quality, ba)) {
+            qWarning() << "Failed to save image to buffer";
+            sendResponse("500 Internal Server Error");
+            return;
+        }
+        responseCache.insert(cacheKey, ba);
+        qDebug() << "Sent image response" << representation << "size:" << ba.size()
+                 << "hits:" << responseCache.hits() << "misses:" << responseCache.misses();
+    }
+
+    if (!selectRange(range, ifRange, entityTag(imagePath, representation), ba.size(), first, last, status, headers)) {
+        return;
+    }
+    if (first == 0 && last == ba.size() - 1) {
+        sendResponse(status, ba, "image/jpeg", headers);
+    } else {
+        sendResponse(status, ba.mid(first, last - first + 1), "image/jpeg", headers);
+    }
+}
+
+QString JPEGConnection::scanTotalKey() const {
+    return ResponseCache::makeKey(scanPath, strategy->name() + "-scans");
+}
+
+void JPEGConnection::beginScanStream(const QString& imagePath) {
+    // Scans are rendered by a private strategy instance: the stream spans
+    // several event loop iterations and the worker's instance is shared.
+    scanStrategy = strategy->clone();
+    scanPath = imagePath;
+    scanIndex = 0;
+    scanDecoded = 0;
+    scanWaiting = false;
+    // Known once a stream of this file has decoded its first scan.
+    QByteArray total;
+    scanTotal = service->cache().lookup(scanTotalKey(), total) ? total.toInt() : 0;
+    keepAlive = false;
+    busy = true;
+    beginResponse("200 OK");
+    socket->write("HTTP/1.1 200 OK\r\n"
+                  "Content-Type: multipart/x-mixed-replace; boundary=" + QByteArray(ScanBoundary) + "\r\n"
+                  "Cache-Control: no-cache\r\n"
+                  "Connection: close\r\n"
+                  "\r\n");
+    sendNextScan();
+}
+
+void JPEGConnection::sendNextScan() {
+    if (closing) {
+        endScanStream();
+        return;
+    }
+    ++scanIndex;
+    QByteArray data;
+    ResponseCache& responseCache = service->cache();
+    const QString cacheKey = ResponseCache::makeKey(scanPath, strategy->name() + "-scan" + QString::number(scanIndex));
+    // Until the total is known, scans come from the decoder, which knows it.
+    if (scanTotal <= 0 || !responseCache.lookup(cacheKey, data)) {
+        if (!renderScan(scanIndex, data)) {
+            qWarning() << "Failed to render scan" << scanIndex << "of" << scanPath;
+            endScanStream();
+            return;
+        }
+        responseCache.insert(cacheKey, data);
+    }
+
+    socket->write("--" + QByteArray(ScanBoundary) + "\r\n"
+                  "Content-Type: image/jpeg\r\n"
+                  "Content-Length: " + QByteArray::number(data.size()) + "\r\n"
+                  "X-Scan: " + QByteArray::number(scanIndex) + '/' + QByteArray::number(scanTotal) + "\r\n"
+                  "\r\n");
+    socket->write(data);
+    socket->write("\r\n");
+
+    const ProgressiveJPEGStrategy* progressive = static_cast<ProgressiveJPEGStrategy*>(scanStrategy);
+    if (scanIndex >= scanTotal || (scanDecoded == scanIndex && !progressive->hasMoreScans())) {
+        endScanStream();
+        return;
+    }
+    // The next scan waits until this one has mostly left the socket, so a
+    // slow reader never makes the server queue every scan of the image.
+    scanWaiting = true;
+}
+
+bool JPEGConnection::renderScan(int scan, QByteArray& data) {
+    ProgressiveJPEGStrategy* progressive = dynamic_cast<ProgressiveJPEGStrategy*>(scanStrategy);
+    if (!progressive) {
+        return false;
+    }
+    // Earlier scans may have come from the cache; catch up from the start.
+    QElapsedTimer decodeTimer;
+    decodeTimer.start();
+    QImage image;
+    if (scanDecoded == 0) {
+        if (!progressive->loadImage(scanPath, image)) {
+            return false;
+        }
+        scanDecoded = 1;
+        if (scanTotal != progressive->scanCount()) {
+            scanTotal = progressive->scanCount();
+            service->cache().insert(scanTotalKey(), QByteArray::number(scanTotal));
+        }
+    }
+    while (scanDecoded < scan) {
+        if (!progressive->loadNextScan(image)) {
+            return false;
+        }
+        ++scanDecoded;
+    }
+    service->metrics().observe(worker, ServerMetrics::Decode, decodeTimer.nsecsElapsed());
+    return encodeImage(image, -1, data);
+}
+
+bool JPEGConnection::encodeImage(const QImage& image, int quality, QByteArray& data) const {
+    // Optimized Huffman tables cost some CPU once per cache entry and save
+    // bytes on every response; progressive strategies also send progressive files.
+    JPEGEncoder::Options options;
+    options.quality = quality;
+    options.optimizeCoding = true;
+    options.progressive = dynamic_cast<ProgressiveJPEGStrategy*>(strategy) != nullptr;
+    QElapsedTimer encodeTimer;
+    encodeTimer.start();
+    const bool encoded = JPEGEncoder::encode(image, options, data);
+    service->metrics().observe(worker, ServerMetrics::Encode, encodeTimer.nsecsElapsed());
+    return encoded;
+}
+
+// The closing boundary goes out whenever the socket is still open, so a
+// stream cut short by a failed scan is still a well-formed multipart body.
+void JPEGConnection::endScanStream() {
+    if (!closing) {
+        socket->write("--" + QByteArray(ScanBoundary) + "--\r\n");
+    }
+    delete scanStrategy;
+    scanStrategy = nullptr;
+    if (closing) {
+        return;
+    }
+    finishResponse();
+}
+
+bool JPEGConnection::selectRange(const QByteArray& range, const QByteArray& ifRange, const QByteArray& etag,
+                                 qint64 size, qint64& first, qint64& last, QByteArray& status, QByteArray& headers) {
+    first = 0;
+    last = size - 1;
+    status = "200 OK";
+    headers = "Accept-Ranges: bytes\r\nETag: " + etag + "\r\n";
+    // A stale If-Range validator means the client's partial copy is useless.
+    if (range.isEmpty() || (!ifRange.isEmpty() && ifRange != etag)) {
+        return true;
+    }
+
+    switch (HttpParser::parseRange(range, size, first, last)) {
+    case HttpParser::NoRange:
+        first = 0;
+        last = size - 1;
+        return true;
+    case HttpParser::RangeNotSatisfiable:
+        qWarning() << "Range not satisfiable:" << range << "size:" << size;
+        sendResponse("416 Range Not Satisfiable", QByteArray(), QByteArray(),
+                     "Content-Range: bytes */" + QByteArray::number(size) + "\r\n");
+        return false;
+    case HttpParser::RangeSatisfiable:
+        break;
+    }
+    status = "206 Partial Content";
+    headers += "Content-Range: bytes " + QByteArray::number(first) + '-' + QByteArray::number(last)
+             + '/' + QByteArray::number(size) + "\r\n";
+    return true;
+}
+
+bool JPEGConnection::beginUpload(qint64 contentLength, const QString& imagePath) {
+    // Same directory as the target so the final commit is a plain rename.
+    const QString dir = QFileInfo(imagePath).absolutePath();
+    uploadFile = new QTemporaryFile(QDir(dir).filePath(".upload-XXXXXX"), this);
+    if (!uploadFile->open()) {
+        qWarning() << "Cannot create upload file in" << dir << uploadFile->errorString();
+        delete uploadFile;
+        uploadFile = nullptr;
+        return false;
+    }
+    uploadTarget = imagePath;
+    uploadExpected = contentLength;
+    uploadReceived = 0;
+    return true;
+}
+
+bool JPEGConnection::receiveUpload() {
+    // Body bytes that arrived together with the header.
+    if (!buffer.isEmpty()) {
+        const qint64 take = qMin<qint64>(buffer.size(), uploadExpected - uploadReceived);
+        if (uploadFile->write(buffer.constData(), take) != take) {
+            abortUpload("500 Internal Server Error");
+            return true;
+        }
+        uploadReceived += take;
+        buffer.remove(0, int(take));
+    }
+
+    if (uploadChunk.size() != UploadChunkSize) {
+        uploadChunk.resize(UploadChunkSize);
+    }
+    while (uploadReceived < uploadExpected) {
+        const qint64 want = qMin<qint64>(UploadChunkSize, uploadExpected - uploadReceived);
+        const qint64 got = socket->read(uploadChunk.data(), want);
+        if (got <= 0) {
+            return false;
+        }
+        service->metrics().addBytesIn(worker, got);
+        if (uploadFile->write(uploadChunk.constData(), got) != got) {
+            abortUpload("500 Internal Server Error");
+            return true;
+        }
+        uploadReceived += got;
+    }
+
+    finishUpload();
+    return true;
+}
+
+void JPEGConnection::abortUpload(const QByteArray& status) {
+    qWarning() << "Upload aborted:" << status << (uploadFile ? uploadFile->errorString() : QString());
+    delete uploadFile;
+    uploadFile = nullptr;
+    keepAlive = false;
+    buffer.clear();
+    sendResponse(status);
+}
+
+void JPEGConnection::finishUpload() {
+    qDebug() << "Upload received:" << uploadReceived << "bytes";
+    if (!uploadFile->flush()) {
+        abortUpload("500 Internal Server Error");
+        return;
+    }
+
+    // Full decode once, from disk, before anything replaces the served file.
+    QImageReader reader(uploadFile->fileName(), "jpeg");
+    if (reader.read().isNull()) {
+        qWarning() << "Failed to load image from POST data:" << reader.errorString();
+        delete uploadFile;
+        uploadFile = nullptr;
+        sendResponse("415 Unsupported Media Type");
+        return;
+    }
+
+    const QString imagePath = uploadTarget;
+    const QString tempPath = uploadFile->fileName();
+    uploadFile->setAutoRemove(false);
+    uploadFile->close();
+    delete uploadFile;
+    uploadFile = nullptr;
+
+    bool saved;
+    {
+        QMutexLocker locker(&service->uploadLock());
+#ifdef Q_OS_WIN
+        QFile::remove(imagePath);
+        saved = QFile::rename(tempPath, imagePath);
+#else
+        saved = ::rename(QFile::encodeName(tempPath).constData(), QFile::encodeName(imagePath).constData()) == 0;
+#endif
+    }
+    qDebug() << "Save result:" << saved << "to" << imagePath;
+    if (!saved) {
+        QFile::remove(tempPath);
+    }
+
+    if (saved) {
+        service->imageUploaded(imagePath);
+        sendResponse("200 OK");
+    } else {
+        sendResponse("500 Internal Server Error");
+    }
+}
+
+QByteArray JPEGConnection::responseHeaders(const QByteArray& status, qint64 contentLength,
+                                           const QByteArray& contentType,
+                                           const QByteArray& extraHeaders) const {
+    QByteArray headers = "HTTP/1.1 " + status + "\r\n";
+    if (!contentType.isEmpty()) {
+        headers += "Content-Type: " + contentType + "\r\n";
+    }
+    headers += extraHeaders;
+    headers += "Content-Length: " + QByteArray::number(contentLength) + "\r\n";
+    if (keepAlive) {
+        headers += "Connection: keep-alive\r\n";
+        headers += "Keep-Alive: timeout=" + QByteArray::number(service->keepAliveTimeout() / 1000)
+                 + ", max=" + QByteArray::number(service->maxRequestsPerConnection() - requestCount - 1) + "\r\n";
+    } else {
+        headers += "Connection: close\r\n";
+    }
+    headers += "\r\n";
+    return headers;
+}
+
+void JPEGConnection::sendResponse(const QByteArray& status, const QByteArray& body,
+                                  const QByteArray& contentType, const QByteArray& extraHeaders) {
+    beginResponse(status);
+    socket->write(responseHeaders(status, body.size(), contentType, extraHeaders));
+    if (!body.isEmpty()) {
+        socket->write(body);
+    }
+    finishResponse();
+}
+
+void JPEGConnection::finishResponse() {
+    ++requestCount;
+    busy = false;
+    recordWriteIfDrained();
+    if (!keepAlive) {
+        closing = true;
+        socket->flush();
+        socket->disconnectFromHost();
+        return;
+    }
+    if (!inProcessLoop) {
+        processBuffer();
+    }
+}
+
+void JPEGConnection::beginResponse(const QByteArray& status) {
+    // The request is complete; nothing runs while the response is sent.
+    idleTimer.stop();
+    requestDeadline = false;
+    service->metrics().countResponse(worker, requestMethod, status);
+    writeTimer.start();
+}
+
+void JPEGConnection::onBytesWritten(qint64 bytes) {
+    service->metrics().addBytesOut(worker, bytes);
+    recordWriteIfDrained();
+    if (scanWaiting && socket->bytesToWrite() <= ScanQueueLimit) {
+        scanWaiting = false;
+        sendNextScan();
+    }
+}
+
+// The write stage runs from the first response byte until the whole
+// response has been handed to the operating system.
+void JPEGConnection::recordWriteIfDrained() {
+    if (!writeTimer.isValid() || busy || socket->bytesToWrite() > 0) {
+        return;
+    }
+    service->metrics().observe(worker, ServerMetrics::Write, writeTimer.nsecsElapsed());
+    writeTimer.invalidate();
+}
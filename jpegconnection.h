@@ -0,0 +1,104 @@
+#ifndef JPEGCONNECTION_H
+#define JPEGCONNECTION_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QImage>
+#include <QTimer>
+#include <QtNetwork/QTcpSocket>
+#include "httpparser.h"
+#include "servermetrics.h"
+
+class QTemporaryFile;
+class JPEGService;
+class JPEGStrategy;
+
+// One client connection (plain or TLS, QSslSocket is a QTcpSocket).
+// Requests are handled strictly in order; the connection stays open between
+// requests until the client asks to close, the idle timeout fires or the
+// per-connection request limit is reached. GET honours single-range Range
+// and If-Range requests against a strong ETag. With a progressive strategy
+// and "Accept: multipart/x-mixed-replace", every scan is pushed as its own
+// part as soon as it is rendered. POST bodies are streamed into a
+// temporary file next to the target image and renamed over it once the
+// upload has been validated. GET /metrics returns the server's counters.
+// Owned by its socket.
+class JPEGConnection : public QObject {
+    Q_OBJECT
+public:
+    JPEGConnection(QTcpSocket* socket, JPEGService* service, int worker);
+    ~JPEGConnection();
+
+private slots:
+    void onReadyRead();
+    void onIdleTimeout();
+    void onDisconnected();
+
+private:
+    void processBuffer();
+    void startTimeout();
+    bool handleNextRequest();
+    void handleGet(const QByteArray& target, const QByteArray& range, const QByteArray& ifRange,
+                   bool acceptsScans);
+    void beginScanStream(const QString& imagePath);
+    void sendNextScan();
+    bool renderScan(int scan, QByteArray& data);
+    bool encodeImage(const QImage& image, int quality, QByteArray& data) const;
+    void endScanStream();
+    QString scanTotalKey() const;
+    bool selectRange(const QByteArray& range, const QByteArray& ifRange, const QByteArray& etag, qint64 size,
+                     qint64& first, qint64& last, QByteArray& status, QByteArray& headers);
+    bool beginUpload(qint64 contentLength, const QString& imagePath);
+    bool receiveUpload();
+    void finishUpload();
+    void abortUpload(const QByteArray& status);
+
+    QByteArray responseHeaders(const QByteArray& status, qint64 contentLength,
+                               const QByteArray& contentType = QByteArray(),
+                               const QByteArray& extraHeaders = QByteArray()) const;
+    void sendResponse(const QByteArray& status, const QByteArray& body = QByteArray(),
+                      const QByteArray& contentType = QByteArray(),
+                      const QByteArray& extraHeaders = QByteArray());
+    void finishResponse();
+    void beginResponse(const QByteArray& status);
+    void onBytesWritten(qint64 bytes);
+    void recordWriteIfDrained();
+
+    QTcpSocket* socket;
+    JPEGService* service;
+    JPEGStrategy* strategy;
+    int worker;
+    QByteArray buffer;
+    HttpParser requestParser;
+    QTemporaryFile* uploadFile;
+    QString uploadTarget;
+    QByteArray uploadChunk;
+    qint64 uploadExpected;
+    qint64 uploadReceived;
+    JPEGStrategy* scanStrategy;
+    QString scanPath;
+    int scanIndex;
+    int scanDecoded;
+    int scanTotal;
+    bool scanWaiting;
+    QTimer idleTimer;
+    int requestCount;
+    bool keepAlive;
+    bool busy;
+    bool closing;
+    bool inProcessLoop;
+    // The request timeout is running for the current request.
+    bool requestDeadline;
+    ServerMetrics::Method requestMethod;
+    qint64 parseNsecs;
+    QElapsedTimer writeTimer;
+
+    static const int MaxHeaderSize = 64 * 1024;
+    static const int UploadChunkSize = 64 * 1024;
+    // Unsent scan bytes allowed in the socket before the next scan is rendered.
+    static const qint64 ScanQueueLimit = 64 * 1024;
+    static constexpr const char* ScanBoundary = "jpegscan";
+};
+
+#endif // JPEGCONNECTION_H
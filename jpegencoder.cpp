@@ -0,0 +1,115 @@
+#include "jpegencoder.h"
+#include <QDebug>
+#include <QSaveFile>
+#include <csetjmp>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <jpeglib.h>
+
+namespace {
+
+struct ErrorManager {
+    jpeg_error_mgr base;
+    std::jmp_buf jump;
+};
+
+// Written by jpeg_mem_dest after setjmp. Locals changed between setjmp and
+// longjmp are indeterminate afterwards, so these live on the heap.
+struct MemoryDestination {
+    unsigned char* buffer = nullptr;
+    unsigned long size = 0;
+
+    ~MemoryDestination() { std::free(buffer); }
+};
+
+void errorExit(j_common_ptr info) {
+    char message[JMSG_LENGTH_MAX];
+    info->err->format_message(info, message);
+    qWarning() << "libjpeg:" << message;
+    std::longjmp(reinterpret_cast<ErrorManager*>(info->err)->jump, 1);
+}
+
+// Decided by format only: isGrayscale() scans every pixel of 32-bit images.
+bool isGrayFormat(const QImage& image) {
+    return image.format() == QImage::Format_Grayscale8 || image.format() == QImage::Format_Grayscale16
+        || (image.format() == QImage::Format_Indexed8 && image.isGrayscale());
+}
+
+J_DCT_METHOD dctMethodFor(int method) {
+    switch (method) {
+    case JPEGEncoder::DctFast:
+        return JDCT_IFAST;
+    case JPEGEncoder::DctFloat:
+        return JDCT_FLOAT;
+    default:
+        return JDCT_ISLOW;
+    }
+}
+
+}
+
+bool JPEGEncoder::encode(const QImage& image, const Options& options, QByteArray& output) {
+    if (image.isNull()) {
+        return false;
+    }
+    const QImage source = image.convertToFormat(isGrayFormat(image) ? QImage::Format_Grayscale8 : QImage::Format_RGB888);
+
+    jpeg_compress_struct cinfo;
+    ErrorManager error;
+    // Everything longjmp can skip over is declared before setjmp.
+    const std::unique_ptr<MemoryDestination> destination(new MemoryDestination);
+
+    cinfo.err = jpeg_std_error(&error.base);
+    error.base.error_exit = errorExit;
+    if (setjmp(error.jump)) {
+        jpeg_destroy_compress(&cinfo);
+        return false;
+    }
+
+    jpeg_create_compress(&cinfo);
+    jpeg_mem_dest(&cinfo, &destination->buffer, &destination->size);
+
+    const bool gray = source.format() == QImage::Format_Grayscale8;
+
+    cinfo.image_width = JDIMENSION(source.width());
+    cinfo.image_height = JDIMENSION(source.height());
+    cinfo.input_components = gray ? 1 : 3;
+    cinfo.in_color_space = gray ? JCS_GRAYSCALE : JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, options.quality < 0 ? 75 : qBound(0, options.quality, 100), TRUE);
+    cinfo.dct_method = dctMethodFor(options.dctMethod);
+    cinfo.optimize_coding = options.optimizeCoding ? TRUE : FALSE;
+    if (!gray) {
+        // Luma sampling factors relative to chroma; jpeg_set_defaults picks 4:2:0.
+        cinfo.comp_info[0].h_samp_factor = options.subsampling == Subsampling444 ? 1 : 2;
+        cinfo.comp_info[0].v_samp_factor = options.subsampling == Subsampling420 ? 2 : 1;
+    }
+    if (options.progressive) {
+        jpeg_simple_progression(&cinfo);
+    }
+
+    jpeg_start_compress(&cinfo, TRUE);
+    while (cinfo.next_scanline < cinfo.image_height) {
+        JSAMPROW row = const_cast<JSAMPROW>(source.constScanLine(int(cinfo.next_scanline)));
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+
+    output = QByteArray(reinterpret_cast<const char*>(destination->buffer), qsizetype(destination->size));
+    return true;
+}
+
+bool JPEGEncoder::save(const QString& filename, const QImage& image, const Options& options) {
+    QByteArray data;
+    if (!encode(image, options, data)) {
+        return false;
+    }
+    QSaveFile file(filename);
+    if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size()) {
+        qWarning() << "Cannot write" << filename << file.errorString();
+        return false;
+    }
+    return file.commit();
+}
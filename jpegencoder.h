@@ -0,0 +1,29 @@
+#ifndef JPEGENCODER_H
+#define JPEGENCODER_H
+
+#include <QByteArray>
+#include <QImage>
+#include <QString>
+
+// JPEG encoder on top of libjpeg, for the options QImageWriter does not
+// expose: progressive scans, DCT method, Huffman table optimization and
+// chroma subsampling.
+class JPEGEncoder {
+public:
+    // Same values as the DCT combo box in MainWindow.
+    enum DctMethod { DctInteger = 0, DctFast = 1, DctFloat = 2 };
+    enum Subsampling { Subsampling420 = 0, Subsampling422 = 1, Subsampling444 = 2 };
+
+    struct Options {
+        int quality = 75;
+        bool progressive = false;
+        int dctMethod = DctInteger;
+        bool optimizeCoding = true;
+        int subsampling = Subsampling420;
+    };
+
+    static bool encode(const QImage& image, const Options& options, QByteArray& output);
+    static bool save(const QString& filename, const QImage& image, const Options& options);
+};
+
+#endif // JPEGENCODER_H
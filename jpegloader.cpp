@@ -1,2 +1,118 @@
 #include "jpegloader.h"
+#include "scanpyramid.h"
+#include <QDebug>
+#include <QElapsedTimer>
 
+// Posts the command's callbacks back to the loader's thread, tagged with the
+// generation they belong to.
+class AsyncImageLoader::ForwardingObserver : public ImageLoadObserver {
+public:
+    ForwardingObserver(AsyncImageLoader* loader, int generation)
+        : loader(loader), generation(generation) {}
+
+    void onImageLoaded(const QImage& image) override {
+        loaded = image;
+        AsyncImageLoader* target = loader;
+        const int run = generation;
+        QMetaObject::invokeMethod(target, [target, run, image] { target->deliverLoaded(run, image); },
+                                  Qt::QueuedConnection);
+    }
+
+    void onLoadError(const QString& error) override {
+        AsyncImageLoader* target = loader;
+        const int run = generation;
+        QMetaObject::invokeMethod(target, [target, run, error] { target->deliverError(run, error); },
+                                  Qt::QueuedConnection);
+    }
+
+    // The image passed to onImageLoaded, if any.
+    QImage loaded;
+
+private:
+    AsyncImageLoader* loader;
+    int generation;
+};
+
+AsyncImageLoader::AsyncImageLoader(ImageLoadObserver* observer, QObject* parent)
+    : QObject(parent), observer(observer), scanPyramid(nullptr), loading(false) {}
+
+AsyncImageLoader::~AsyncImageLoader() {
+    cancel();
+    pool.waitForDone();
+}
+
+void AsyncImageLoader::load(ImageHandler::HandlerType type, const QString& filename) {
+    const int generation = currentGeneration.fetchAndAddOrdered(1) + 1;
+    // Queued loads that never started are dropped outright.
+    pool.clear();
+    currentFilename = filename;
+    loading = true;
+    // Also releases a previous run blocked on a full pyramid.
+    ScanPyramid* pyramid = scanPyramid;
+    const int scanRun = pyramid ? pyramid->start() : 0;
+    pool.start([this, type, filename, generation, pyramid, scanRun] {
+        run(type, filename, generation, pyramid, scanRun);
+    });
+}
+
+void AsyncImageLoader::cancel() {
+    currentGeneration.fetchAndAddOrdered(1);
+    pool.clear();
+    loading = false;
+    if (scanPyramid) {
+        scanPyramid->cancel();
+    }
+}
+
+void AsyncImageLoader::run(ImageHandler::HandlerType type, const QString& filename, int generation,
+                           ScanPyramid* pyramid, int scanRun) {
+    if (!isCurrent(generation)) {
+        return;
+    }
+    QElapsedTimer timer;
+    timer.start();
+    ImageHandler* handler = ImageHandler::createHandler(type);
+    // A superseded or cancelled load stops mid-decode instead of finishing.
+    handler->setCancelCheck([this, generation] { return !isCurrent(generation); });
+    ForwardingObserver forward(this, generation);
+    LoadImageCommand command(handler, filename, &forward);
+    command.execute();
+    qDebug() << "Loaded" << filename << "in" << timer.elapsed() << "ms"
+             << (isCurrent(generation) ? "" : "(superseded)");
+
+    // The pyramid gets the first image and then the handler's further
+    // scans, all from this one decode.
+    if (pyramid) {
+        QImage scan = forward.loaded;
+        int scans = 0;
+        while (!scan.isNull() && isCurrent(generation) && pyramid->addScan(scanRun, scan)) {
+            ++scans;
+            if (!handler->hasMoreScans() || !handler->loadNextScan(scan)) {
+                break;
+            }
+        }
+        pyramid->finish(scanRun);
+        qDebug() << "Decoded" << scans << "scans of" << filename << "in" << timer.elapsed() << "ms";
+    }
+    delete handler;
+}
+
+void AsyncImageLoader::deliverLoaded(int generation, const QImage& image) {
+    if (!isCurrent(generation)) {
+        return;
+    }
+    loading = false;
+    if (observer) {
+        observer->onImageLoaded(image);
+    }
+}
+
+void AsyncImageLoader::deliverError(int generation, const QString& error) {
+    if (!isCurrent(generation)) {
+        return;
+    }
+    loading = false;
+    if (observer) {
+        observer->onLoadError(error);
+    }
+}
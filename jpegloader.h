@@ -3,8 +3,12 @@
 
 #include "imagehandler.h"
 #include <QObject>
+#include <QAtomicInt>
 #include <QImage>
 #include <QString>
+#include <QThreadPool>
+
+class ScanPyramid;
 
 class ImageLoadObserver {
 public:
@@ -56,5 +60,45 @@ private:
     ImageLoadObserver* observer;
 };
 
+// Runs LoadImageCommands on a thread pool, each with a handler of its own,
+// and reports to the observer on the loader's thread. Every load()
+// supersedes the previous one: a load that has not started yet never runs,
+// one that is decoding stops between rows, and results of superseded or
+// cancelled loads are dropped.
+class AsyncImageLoader : public QObject {
+    Q_OBJECT
+public:
+    explicit AsyncImageLoader(ImageLoadObserver* observer, QObject* parent = nullptr);
+    ~AsyncImageLoader();
+
+    // With a pyramid set, a load keeps decoding after the first image and
+    // adds every scan to it, starting a new pyramid run per load. The
+    // pyramid must outlive the loader.
+    void setScanPyramid(ScanPyramid* pyramid) { scanPyramid = pyramid; }
+
+    void load(ImageHandler::HandlerType type, const QString& filename);
+    void cancel();
+
+    bool isLoading() const { return loading; }
+    // File of the current (or last finished) load.
+    QString filename() const { return currentFilename; }
+
+private:
+    class ForwardingObserver;
+
+    void run(ImageHandler::HandlerType type, const QString& filename, int generation,
+             ScanPyramid* pyramid, int scanRun);
+    bool isCurrent(int generation) const { return generation == currentGeneration.loadAcquire(); }
+    void deliverLoaded(int generation, const QImage& image);
+    void deliverError(int generation, const QString& error);
+
+    ImageLoadObserver* observer;
+    ScanPyramid* scanPyramid;
+    QThreadPool pool;
+    QAtomicInt currentGeneration;
+    QString currentFilename;
+    bool loading;
+};
+
 #endif // JPEGLOADER_H
 
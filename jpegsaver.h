@@ -9,12 +9,12 @@
 class SaveImageCommand {
 public:
     SaveImageCommand(ImageHandler* handler, const QString& filename, const QImage& image,
-                    int quality, bool progressive, int dctMethod)
+                    int quality, bool progressive, int dctMethod, int subsampling)
         : handler(handler), filename(filename), image(image),
-          quality(quality), progressive(progressive), dctMethod(dctMethod) {}
+          quality(quality), progressive(progressive), dctMethod(dctMethod), subsampling(subsampling) {}
     
     bool execute() {
-        return handler->saveImage(filename, image, quality, progressive, dctMethod);
+        return handler->saveImage(filename, image, quality, progressive, dctMethod, subsampling);
     }
 
 private:
@@ -24,6 +24,7 @@ private:
     int quality;
     bool progressive;
     int dctMethod;
+    int subsampling;
 };
 
 #endif // JPEGSAVER_H
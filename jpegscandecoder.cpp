@@ -0,0 +1,405 @@
+#include "jpegscandecoder.h"
+#include <QDebug>
+#include <QFile>
+#include <csetjmp>
+#include <cstdio>
+#include <cstring>
+#include <jpeglib.h>
+
+namespace {
+
+struct ErrorManager {
+    jpeg_error_mgr base;
+    std::jmp_buf jump;
+};
+
+void errorExit(j_common_ptr info) {
+    char message[JMSG_LENGTH_MAX];
+    info->err->format_message(info, message);
+    qWarning() << "libjpeg:" << message;
+    std::longjmp(reinterpret_cast<ErrorManager*>(info->err)->jump, 1);
+}
+
+// Corrupt-data warnings are expected on truncated streams; stay quiet.
+void outputMessage(j_common_ptr) {}
+
+}
+
+struct JPEGScanDecoder::Private {
+    enum State { Header, Start, WaitScan, StartOutput, Output, FinishOutput, Finishing, Done, Error };
+
+    jpeg_decompress_struct cinfo;
+    ErrorManager error;
+    jpeg_source_mgr source;
+    bool created = false;
+
+    QByteArray data;
+    // Start and size of the input: data, or a caller's buffer.
+    const char* input = nullptr;
+    qsizetype inputSize = 0;
+    long pendingSkip = 0;
+    bool complete = false;
+    bool eoiInserted = false;
+
+    State state = Header;
+    bool progressive = false;
+    int scans = 0;
+    int targetScan = 0;
+    bool latestOnly = false;
+    std::function<bool()> cancelCheck;
+    QImage current;
+
+    static Private* from(j_decompress_ptr cinfo) {
+        return static_cast<Private*>(cinfo->client_data);
+    }
+
+    bool cancelled() {
+        if (cancelCheck && cancelCheck()) {
+            state = Error;
+            return true;
+        }
+        return false;
+    }
+
+    static void initSource(j_decompress_ptr) {}
+    static void termSource(j_decompress_ptr) {}
+
+    // Suspends (returns FALSE) until more data is appended; once the input
+    // is complete a truncated stream is terminated with a fake EOI.
+    static boolean fillInputBuffer(j_decompress_ptr cinfo) {
+        Private* d = from(cinfo);
+        if (!d->complete) {
+            return FALSE;
+        }
+        static const JOCTET eoi[2] = { 0xFF, JPEG_EOI };
+        d->eoiInserted = true;
+        cinfo->src->next_input_byte = eoi;
+        cinfo->src->bytes_in_buffer = 2;
+        return TRUE;
+    }
+
+    // libjpeg keeps a pointer into the input; re-point it after the input
+    // grew or moved, keeping its position.
+    void setInput(const char* start, qsizetype size) {
+        const qsizetype offset = source.next_input_byte
+            ? reinterpret_cast<const char*>(source.next_input_byte) - input : 0;
+        input = start;
+        inputSize = size;
+        qsizetype position = offset;
+        qsizetype available = size - offset;
+        const qsizetype skip = qMin<qsizetype>(pendingSkip, available);
+        position += skip;
+        available -= skip;
+        pendingSkip -= long(skip);
+        source.next_input_byte = reinterpret_cast<const JOCTET*>(input + position);
+        source.bytes_in_buffer = size_t(available);
+    }
+
+    // False while suspended or on an unsupported image; the caller's setjmp
+    // covers libjpeg errors.
+    bool readHeader() {
+        if (jpeg_read_header(&cinfo, TRUE) == JPEG_SUSPENDED) {
+            return false;
+        }
+        if (cinfo.jpeg_color_space == JCS_CMYK || cinfo.jpeg_color_space == JCS_YCCK) {
+            qWarning() << "CMYK JPEG not supported by the scan decoder";
+            state = Error;
+            return false;
+        }
+        progressive = jpeg_has_multiple_scans(&cinfo);
+        cinfo.buffered_image = progressive ? TRUE : FALSE;
+        cinfo.out_color_space = cinfo.jpeg_color_space == JCS_GRAYSCALE ? JCS_GRAYSCALE : JCS_RGB;
+        state = Start;
+        return true;
+    }
+
+    static void skipInputData(j_decompress_ptr cinfo, long count) {
+        if (count <= 0) {
+            return;
+        }
+        jpeg_source_mgr* src = cinfo->src;
+        if (size_t(count) <= src->bytes_in_buffer) {
+            src->next_input_byte += count;
+            src->bytes_in_buffer -= size_t(count);
+            return;
+        }
+        from(cinfo)->pendingSkip = count - long(src->bytes_in_buffer);
+        src->next_input_byte += src->bytes_in_buffer;
+        src->bytes_in_buffer = 0;
+    }
+};
+
+JPEGScanDecoder::JPEGScanDecoder() : d(new Private) {
+    reset();
+}
+
+JPEGScanDecoder::~JPEGScanDecoder() {
+    if (d->created) {
+        jpeg_destroy_decompress(&d->cinfo);
+    }
+    delete d;
+}
+
+void JPEGScanDecoder::reset() {
+    if (d->created) {
+        jpeg_destroy_decompress(&d->cinfo);
+        d->created = false;
+    }
+    d->data.clear();
+    d->input = nullptr;
+    d->inputSize = 0;
+    d->pendingSkip = 0;
+    d->complete = false;
+    d->eoiInserted = false;
+    d->progressive = false;
+    d->scans = 0;
+    d->targetScan = 0;
+    d->current = QImage();
+
+    d->cinfo.err = jpeg_std_error(&d->error.base);
+    d->error.base.error_exit = errorExit;
+    d->error.base.output_message = outputMessage;
+    if (setjmp(d->error.jump)) {
+        d->state = Private::Error;
+        return;
+    }
+    jpeg_create_decompress(&d->cinfo);
+    d->created = true;
+    d->cinfo.client_data = d;
+    d->source.init_source = Private::initSource;
+    d->source.fill_input_buffer = Private::fillInputBuffer;
+    d->source.skip_input_data = Private::skipInputData;
+    d->source.resync_to_restart = jpeg_resync_to_restart;
+    d->source.term_source = Private::termSource;
+    d->source.next_input_byte = nullptr;
+    d->source.bytes_in_buffer = 0;
+    d->cinfo.src = &d->source;
+    d->state = Private::Header;
+}
+
+bool JPEGScanDecoder::openFile(const QString& filename) {
+    reset();
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    appendData(file.readAll());
+    setComplete();
+    return d->inputSize > 0;
+}
+
+void JPEGScanDecoder::appendData(const QByteArray& bytes) {
+    if (d->complete || bytes.isEmpty()) {
+        return;
+    }
+    d->data.append(bytes);
+    d->setInput(d->data.constData(), d->data.size());
+}
+
+void JPEGScanDecoder::setSource(const char* data, qsizetype available) {
+    if (d->complete || !data || available < d->inputSize) {
+        return;
+    }
+    d->setInput(data, available);
+}
+
+void JPEGScanDecoder::setComplete() {
+    d->complete = true;
+}
+
+bool JPEGScanDecoder::readHeader() {
+    if (d->state == Private::Error) {
+        return false;
+    }
+    if (d->state != Private::Header) {
+        return true;
+    }
+    if (setjmp(d->error.jump)) {
+        d->state = Private::Error;
+        return false;
+    }
+    return d->readHeader();
+}
+
+JPEGScanDecoder::Status JPEGScanDecoder::decodeNextScan(QImage& image) {
+    if (d->state == Private::Error) {
+        return Failed;
+    }
+    if (d->state == Private::Done) {
+        return Finished;
+    }
+    jpeg_decompress_struct* cinfo = &d->cinfo;
+    if (setjmp(d->error.jump)) {
+        d->state = Private::Error;
+        return Failed;
+    }
+
+    if (d->state == Private::Header && !d->readHeader()) {
+        return d->state == Private::Error ? Failed : NeedMoreData;
+    }
+
+    if (d->state == Private::Start) {
+        if (!jpeg_start_decompress(cinfo)) {
+            return NeedMoreData;
+        }
+        d->state = d->progressive ? Private::WaitScan : Private::StartOutput;
+    }
+
+    if (d->state == Private::WaitScan && d->latestOnly) {
+        // Absorb everything available; the newest scan whose data is all in
+        // is the one before the scan being read, or the last one at the end.
+        while (!jpeg_input_complete(cinfo)) {
+            if (d->cancelled()) {
+                return Failed;
+            }
+            const int status = jpeg_consume_input(cinfo);
+            if (status == JPEG_SUSPENDED) {
+                break;
+            }
+        }
+        d->targetScan = jpeg_input_complete(cinfo) ? cinfo->input_scan_number : cinfo->input_scan_number - 1;
+        if (d->targetScan <= cinfo->output_scan_number) {
+            return NeedMoreData;
+        }
+        d->state = Private::StartOutput;
+    }
+
+    if (d->state == Private::WaitScan) {
+        // Absorb input until the scan after the last output one is complete,
+        // i.e. the next scan has started or the end of the image was reached.
+        while (true) {
+            if (jpeg_input_complete(cinfo)) {
+                d->targetScan = cinfo->input_scan_number;
+                break;
+            }
+            if (d->cancelled()) {
+                return Failed;
+            }
+            const int status = jpeg_consume_input(cinfo);
+            if (status == JPEG_SUSPENDED) {
+                return NeedMoreData;
+            }
+            if (status == JPEG_REACHED_SOS && cinfo->input_scan_number - 1 > cinfo->output_scan_number) {
+                d->targetScan = cinfo->input_scan_number - 1;
+                break;
+            }
+        }
+        d->state = Private::StartOutput;
+    }
+
+    if (d->state == Private::StartOutput) {
+        if (d->progressive && !jpeg_start_output(cinfo, d->targetScan)) {
+            return NeedMoreData;
+        }
+        d->current = QImage(int(cinfo->output_width), int(cinfo->output_height),
+                            cinfo->out_color_components == 1 ? QImage::Format_Grayscale8 : QImage::Format_RGB888);
+        if (!d->progressive) {
+            d->current.fill(Qt::gray);
+        }
+        d->state = Private::Output;
+    }
+
+    if (d->state == Private::Output) {
+        while (cinfo->output_scanline < cinfo->output_height) {
+            if (d->cancelled()) {
+                return Failed;
+            }
+            JSAMPROW row = d->current.scanLine(int(cinfo->output_scanline));
+            if (jpeg_read_scanlines(cinfo, &row, 1) != 1) {
+                return NeedMoreData;
+            }
+        }
+        d->state = Private::FinishOutput;
+    }
+
+    if (d->state == Private::FinishOutput) {
+        if (d->progressive && !jpeg_finish_output(cinfo)) {
+            return NeedMoreData;
+        }
+        ++d->scans;
+        image = d->current;
+        d->current = QImage();
+        const bool last = !d->progressive
+            || (jpeg_input_complete(cinfo) && cinfo->output_scan_number >= cinfo->input_scan_number);
+        d->state = last ? Private::Finishing : Private::WaitScan;
+        return ScanReady;
+    }
+
+    if (d->state == Private::Finishing) {
+        if (!jpeg_finish_decompress(cinfo)) {
+            return NeedMoreData;
+        }
+        d->state = Private::Done;
+    }
+    return Finished;
+}
+
+void JPEGScanDecoder::setLatestScanOnly(bool latest) {
+    d->latestOnly = latest;
+}
+
+void JPEGScanDecoder::setCancelCheck(const std::function<bool()>& cancelled) {
+    d->cancelCheck = cancelled;
+}
+
+int JPEGScanDecoder::rowsDecoded() const {
+    return d->state == Private::Output ? int(d->cinfo.output_scanline) : 0;
+}
+
+QImage JPEGScanDecoder::partialImage() const {
+    return d->state == Private::Output ? d->current : QImage();
+}
+
+bool JPEGScanDecoder::isProgressive() const {
+    return d->progressive;
+}
+
+bool JPEGScanDecoder::hasMoreScans() const {
+    return d->state != Private::Finishing && d->state != Private::Done && d->state != Private::Error;
+}
+
+int JPEGScanDecoder::scansDecoded() const {
+    return d->scans;
+}
+
+int JPEGScanDecoder::scansInInput() const {
+    return countScans(QByteArray::fromRawData(d->input, d->inputSize));
+}
+
+int JPEGScanDecoder::countScans(const QByteArray& data) {
+    const uchar* p = reinterpret_cast<const uchar*>(data.constData());
+    const qsizetype size = data.size();
+    if (size < 2 || p[0] != 0xFF || p[1] != 0xD8) {
+        return 0;
+    }
+    int scans = 0;
+    qsizetype i = 2;
+    while (i + 1 < size) {
+        if (p[i] != 0xFF) {
+            // Entropy-coded data: jump to the next marker candidate.
+            const void* next = std::memchr(p + i, 0xFF, size_t(size - i));
+            if (!next) {
+                break;
+            }
+            i = static_cast<const uchar*>(next) - p;
+            continue;
+        }
+        const uchar marker = p[i + 1];
+        if (marker == 0xFF) {
+            ++i;
+            continue;
+        }
+        if (marker == 0x00 || (marker >= 0xD0 && marker <= 0xD7)) {
+            i += 2;
+            continue;
+        }
+        if (marker == 0xD9 || i + 3 >= size) {
+            break;
+        }
+        if (marker == 0xDA) {
+            ++scans;
+        }
+        i += 2 + ((p[i + 2] << 8) | p[i + 3]);
+    }
+    return scans;
+}
@@ -0,0 +1,69 @@
+#ifndef JPEGSCANDECODER_H
+#define JPEGSCANDECODER_H
+
+#include <QByteArray>
+#include <QImage>
+#include <QString>
+#include <functional>
+
+// Scan-by-scan JPEG decoder on top of libjpeg's buffered-image mode.
+//
+// Progressive files yield one image per scan in the file; baseline files
+// yield a single image. Input can be a whole file or a buffer that grows as
+// bytes arrive: decodeNextScan() returns NeedMoreData instead of blocking,
+// and continues where it stopped after appendData() or setSource(). Only
+// scans whose data is complete are output, so every image shows exactly
+// one more scan.
+class JPEGScanDecoder {
+public:
+    enum Status { NeedMoreData, ScanReady, Finished, Failed };
+
+    JPEGScanDecoder();
+    ~JPEGScanDecoder();
+
+    void reset();
+    bool openFile(const QString& filename);
+    void appendData(const QByteArray& bytes);
+    // Decodes from a buffer owned by the caller instead of an internal copy:
+    // its first available bytes are valid. Call again whenever more bytes
+    // are in place or the buffer moved; bytes already passed must stay
+    // unchanged until reset(). Not to be mixed with appendData().
+    void setSource(const char* data, qsizetype available);
+    // No more data will arrive; a truncated stream is finished as-is.
+    void setComplete();
+
+    // Parses only the header, so isProgressive() is known before any pixel
+    // is decoded. False while more data is needed, or after an error
+    // (hasMoreScans() is then false too).
+    bool readHeader();
+    Status decodeNextScan(QImage& image);
+    // With latest-only set, decodeNextScan() absorbs all input available and
+    // outputs only the newest complete scan, skipping intermediate ones.
+    void setLatestScanOnly(bool latest);
+    // Polled between rows of input and output; once it returns true the
+    // decode stops and decodeNextScan() returns Failed. Kept across reset().
+    void setCancelCheck(const std::function<bool()>& cancelled);
+
+    // Baseline files are output row by row: while decodeNextScan() waits
+    // for data, the rows decoded so far are available, the rest grey.
+    int rowsDecoded() const;
+    QImage partialImage() const;
+
+    bool isProgressive() const;
+    bool hasMoreScans() const;
+    int scansDecoded() const;
+    // Scans in the input so far: for a complete file, the scans it yields.
+    int scansInInput() const;
+
+    // Number of scans (SOS markers) in a complete JPEG stream.
+    static int countScans(const QByteArray& data);
+
+private:
+    struct Private;
+    Private* d;
+
+    JPEGScanDecoder(const JPEGScanDecoder&) = delete;
+    JPEGScanDecoder& operator=(const JPEGScanDecoder&) = delete;
+};
+
+#endif // JPEGSCANDECODER_H
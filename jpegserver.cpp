@@ -1,166 +1,66 @@
 #include "jpegserver.h"
+#include "jpegconnection.h"
 #include <QtNetwork/QHostAddress>
-#include <QFile>
-#include <QImage>
-#include <QBuffer>
 #include <QDebug>
 
 JPEGServer::JPEGServer(QObject* parent)
-    : QTcpServer(parent), strategy(nullptr) {}
+    : QTcpServer(parent) {}
 
 void JPEGServer::setStrategy(JPEGStrategy* s) {
-    strategy = s;
+    service.setStrategy(s);
 }
 
-void JPEGServer::setImagePath(const QString& path) {
-    imagePath = path;
+void JPEGServer::setThreadCount(int count) {
+    service.setThreadCount(count);
 }
 
-void JPEGServer::incomingConnection(qintptr socketDescriptor) {
-    QTcpSocket* socket = new QTcpSocket(this);
-    if (!socket->setSocketDescriptor(socketDescriptor)) {
-        qWarning() << "Failed to set socket descriptor:" << socket->errorString();
-        delete socket;
-        return;
-    }
-
-    QByteArray* accum = new QByteArray();
-    bool* requestProcessed = new bool(false);
-    int* expectedContentLength = new int(-1);
-
-    connect(socket, &QTcpSocket::readyRead, [this, socket, accum, requestProcessed, expectedContentLength]() {
-        if (*requestProcessed) {
-            return;
-        }
-
-        accum->append(socket->readAll());
-
-        int headerEnd = accum->indexOf("\r\n\r\n");
-        if (headerEnd == -1) {
-            return;
-        }
-
-        QByteArray header = accum->left(headerEnd);
-        QByteArray body = accum->mid(headerEnd + 4);
-
-        qDebug() << "Incoming request header:" << header.left(200);
+void JPEGServer::setImagePath(const QString& path) {
+    service.setImagePath(path);
+}
 
-        if (header.startsWith("GET ")) {
-            *requestProcessed = true;
-            QImage image;
-            if (strategy && !imagePath.isEmpty() && strategy->loadImage(imagePath, image)) {
-                QByteArray ba;
-                QBuffer buffer(&ba);
-                buffer.open(QIODevice::WriteOnly);
-                if (image.save(&buffer, "JPEG")) {
-                    QByteArray response = "HTTP/1.1 200 OK\r\n"
-                                         "Content-Type: image/jpeg\r\n"
-                                         "Content-Length: " + QByteArray::number(ba.size()) + "\r\n"
-                                         "Connection: close\r\n\r\n" + ba;
-                    socket->write(response);
-                    qDebug() << "Sent image response, size:" << ba.size();
-                } else {
-                    QByteArray response = "HTTP/1.1 500 Internal Server Error\r\n"
-                                         "Content-Length: 0\r\n\r\n";
-                    socket->write(response);
-                    qWarning() << "Failed to save image to buffer";
-                }
-            } else {
-                QByteArray response = "HTTP/1.1 404 Not Found\r\n"
-                                     "Content-Length: 0\r\n\r\n";
-                socket->write(response);
-                qWarning() << "Image not found or failed to load:" << imagePath;
-            }
-            socket->flush();
-            socket->disconnectFromHost();
-            return;
-        }
+void JPEGServer::setCacheSize(qint64 bytes) {
+    service.setCacheSize(bytes);
+}
 
-        if (header.startsWith("POST ")) {
-            if (*expectedContentLength < 0) {
-                QList<QByteArray> lines = header.split('\n');
-                for (const QByteArray& line : lines) {
-                    QByteArray trimmedLine = line.trimmed();
-                    if (trimmedLine.toLower().startsWith("content-length:")) {
-                        QByteArray val = trimmedLine.mid(15).trimmed();
-                        bool ok;
-                        *expectedContentLength = val.toInt(&ok);
-                        if (!ok || *expectedContentLength < 0) {
-                            *expectedContentLength = 0;
-                        }
-                        break;
-                    }
-                }
-            }
+void JPEGServer::setVariantCache(qint64 memoryBytes, const QString& directory, qint64 diskBytes) {
+    service.setVariantCache(memoryBytes, directory, diskBytes);
+}
 
-            if (*expectedContentLength <= 0) {
-                *requestProcessed = true;
-                QByteArray response = "HTTP/1.1 400 Bad Request\r\n"
-                                     "Content-Length: 0\r\n\r\n";
-                socket->write(response);
-                socket->disconnectFromHost();
-                qWarning() << "Invalid or missing Content-Length in POST request";
-                return;
-            }
+void JPEGServer::setPassthrough(bool enabled) {
+    service.setPassthrough(enabled);
+}
 
-            if (body.size() < *expectedContentLength) {
-                qDebug() << "Waiting for more body bytes: have" << body.size() 
-                         << "need" << *expectedContentLength;
-                return;
-            }
+void JPEGServer::setKeepAlive(int idleTimeoutMs, int maxRequests) {
+    service.setKeepAlive(idleTimeoutMs, maxRequests);
+}
 
-            *requestProcessed = true;
-            QByteArray imageData = body.left(*expectedContentLength);
-            QImage img;
-            
-            if (!img.loadFromData(imageData, "JPEG")) {
-                QByteArray response = "HTTP/1.1 415 Unsupported Media Type\r\n"
-                                     "Content-Length: 0\r\n\r\n";
-                socket->write(response);
-                socket->disconnectFromHost();
-                qWarning() << "Failed to load image from POST data";
-                return;
-            }
+void JPEGServer::setRequestTimeout(int timeoutMs) {
+    service.setRequestTimeout(timeoutMs);
+}
 
-            bool saved = false;
-            if (!imagePath.isEmpty()) {
-                saved = img.save(imagePath, "JPEG");
-                qDebug() << "Save result:" << saved << "to" << imagePath;
-            } else {
-                qWarning() << "Image path is empty, cannot save uploaded image";
-            }
+void JPEGServer::setMaxUploadSize(qint64 bytes) {
+    service.setMaxUploadSize(bytes);
+}
 
-            if (saved) {
-                QByteArray response = "HTTP/1.1 200 OK\r\n"
-                                     "Content-Length: 0\r\n\r\n";
-                socket->write(response);
-            } else {
-                QByteArray response = "HTTP/1.1 500 Internal Server Error\r\n"
-                                     "Content-Length: 0\r\n\r\n";
-                socket->write(response);
-            }
-            socket->flush();
-            socket->disconnectFromHost();
-            return;
-        }
+const ResponseCache& JPEGServer::cache() {
+    return service.cache();
+}
 
-        *requestProcessed = true;
-        QByteArray response = "HTTP/1.1 400 Bad Request\r\n"
-                             "Content-Length: 0\r\n\r\n";
-        socket->write(response);
-        socket->disconnectFromHost();
-        qWarning() << "Unknown HTTP method in request";
+void JPEGServer::incomingConnection(qintptr socketDescriptor) {
+    service.dispatch([this, socketDescriptor](int worker) {
+        handleConnection(socketDescriptor, worker);
     });
+}
 
-    connect(socket, QOverload<QAbstractSocket::SocketError>::of(&QTcpSocket::errorOccurred),
-            [socket](QAbstractSocket::SocketError error) {
-        qWarning() << "Socket error:" << error << socket->errorString();
-    });
+void JPEGServer::handleConnection(qintptr socketDescriptor, int worker) {
+    // Worker sockets must not have a parent living in another thread.
+    QTcpSocket* socket = new QTcpSocket(worker < 0 ? this : nullptr);
+    if (!socket->setSocketDescriptor(socketDescriptor)) {
+        qWarning() << "Failed to set socket descriptor:" << socket->errorString();
+        delete socket;
+        service.release(worker);
+        return;
+    }
 
-    connect(socket, &QTcpSocket::disconnected, [socket, accum, requestProcessed, expectedContentLength]() {
-        delete accum;
-        delete requestProcessed;
-        delete expectedContentLength;
-        socket->deleteLater();
-    });
+    new JPEGConnection(socket, &service, worker);
 }
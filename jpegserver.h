@@ -5,18 +5,28 @@
 #include <QtNetwork/QTcpSocket>
 #include <QObject>
 #include "jpegstrategy.h"
+#include "jpegservice.h"
 
 class JPEGServer : public QTcpServer {
     Q_OBJECT
 public:
     explicit JPEGServer(QObject* parent = nullptr);
     void setStrategy(JPEGStrategy* strategy);
+    void setThreadCount(int count);
     void setImagePath(const QString& path);
+    void setCacheSize(qint64 bytes);
+    void setVariantCache(qint64 memoryBytes, const QString& directory, qint64 diskBytes);
+    void setPassthrough(bool enabled);
+    void setKeepAlive(int idleTimeoutMs, int maxRequests);
+    void setRequestTimeout(int timeoutMs);
+    void setMaxUploadSize(qint64 bytes);
+    const ResponseCache& cache();
 protected:
     void incomingConnection(qintptr socketDescriptor) override;
 private:
-    JPEGStrategy* strategy;
-    QString imagePath;
+    void handleConnection(qintptr socketDescriptor, int worker);
+
+    JPEGService service;
 };
 
 #endif // JPEGSERVER_H
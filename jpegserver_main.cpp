@@ -1,6 +1,7 @@
 #include <QCoreApplication>
 #include <QCommandLineParser>
 #include <QDebug>
+#include <QThread>
 #include "jpegserver.h"
 #include "jpegstrategy.h"
 
@@ -10,24 +11,65 @@ int main(int argc, char *argv[])
     QCommandLineParser parser;
     parser.setApplicationDescription("JPEG Server");
     parser.addHelpOption();
-    parser.addPositionalArgument("file", "Path to JPEG file to serve.");
+    parser.addPositionalArgument("path", "JPEG file to serve, or a directory of JPEG files served by request path.");
     QCommandLineOption portOpt({"p", "port"}, "Port to listen on.", "port", "12345");
     QCommandLineOption progressiveOpt({"g", "progressive"}, "Serve as progressive JPEG.");
+    QCommandLineOption cacheSizeOpt({"c", "cache-size"}, "Encoded response cache size in MiB (0 disables).", "mib", "64");
+    QCommandLineOption variantCacheOpt("variant-cache", "Memory cache for scaled variants (?w=&h=&q=) in MiB.", "mib", "32");
+    QCommandLineOption variantDiskOpt("variant-disk-cache", "Disk cache for scaled variants in MiB (0 disables).", "mib", "512");
+    QCommandLineOption variantDirOpt("variant-dir", "Directory of the variant disk cache; the disk tier is off without it.", "dir");
+    QCommandLineOption passthroughOpt("passthrough", "Send the file as-is (sendfile) instead of re-encoding it. Standard mode only.");
+    QCommandLineOption threadsOpt({"t", "threads"}, "Number of worker threads (0 handles connections on the main thread).",
+                                  "count", QString::number(QThread::idealThreadCount()));
+    QCommandLineOption keepAliveOpt({"k", "keep-alive"}, "Idle timeout for persistent connections in seconds (0 disables keep-alive).", "seconds", "5");
+    QCommandLineOption requestTimeoutOpt("request-timeout", "Time allowed to send a complete request in seconds.", "seconds", "30");
+    QCommandLineOption maxRequestsOpt("max-requests", "Maximum requests served per connection.", "count", "100");
+    QCommandLineOption maxBodyOpt("max-body", "Maximum POST body size in MiB.", "mib", "256");
     parser.addOption(portOpt);
     parser.addOption(progressiveOpt);
+    parser.addOption(cacheSizeOpt);
+    parser.addOption(variantCacheOpt);
+    parser.addOption(variantDiskOpt);
+    parser.addOption(variantDirOpt);
+    parser.addOption(threadsOpt);
+    parser.addOption(keepAliveOpt);
+    parser.addOption(requestTimeoutOpt);
+    parser.addOption(maxRequestsOpt);
+    parser.addOption(maxBodyOpt);
+    parser.addOption(passthroughOpt);
     parser.process(app);
 
     const QStringList args = parser.positionalArguments();
     if (args.isEmpty()) {
-        qCritical() << "No JPEG file specified.";
+        qCritical() << "No JPEG file or directory specified.";
         return 1;
     }
     QString filePath = args.first();
     int port = parser.value(portOpt).toInt();
     bool progressive = parser.isSet(progressiveOpt);
+    qint64 cacheSize = parser.value(cacheSizeOpt).toLongLong() * 1024 * 1024;
+    qint64 variantCacheSize = parser.value(variantCacheOpt).toLongLong() * 1024 * 1024;
+    qint64 variantDiskSize = parser.value(variantDiskOpt).toLongLong() * 1024 * 1024;
+    QString variantDir = parser.value(variantDirOpt);
+    int threads = parser.value(threadsOpt).toInt();
+    int keepAliveMs = parser.value(keepAliveOpt).toInt() * 1000;
+    int requestTimeoutMs = parser.value(requestTimeoutOpt).toInt() * 1000;
+    int maxRequests = parser.value(maxRequestsOpt).toInt();
+    qint64 maxBody = parser.value(maxBodyOpt).toLongLong() * 1024 * 1024;
+    bool passthrough = parser.isSet(passthroughOpt);
+    if (passthrough && progressive) {
+        qWarning() << "--passthrough has no effect in progressive mode";
+    }
 
     JPEGServer server;
     server.setImagePath(filePath);
+    server.setCacheSize(cacheSize);
+    server.setVariantCache(variantCacheSize, variantDir, variantDiskSize);
+    server.setThreadCount(threads);
+    server.setKeepAlive(keepAliveMs, maxRequests);
+    server.setRequestTimeout(requestTimeoutMs);
+    server.setMaxUploadSize(maxBody);
+    server.setPassthrough(passthrough);
     if (progressive)
         server.setStrategy(new ProgressiveJPEGStrategy());
     else
@@ -36,6 +78,6 @@ int main(int argc, char *argv[])
         qCritical() << "Server failed to start on port" << port;
         return 1;
     }
-    qDebug() << "JPEG server started on port" << port << ", file:" << filePath << (progressive ? "(progressive)" : "(standard)");
+    qDebug() << "JPEG server started on port" << port << ", path:" << filePath << (progressive ? "(progressive)" : "(standard)");
     return app.exec();
 }
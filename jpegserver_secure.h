@@ -5,18 +5,32 @@
 #include <QtNetwork/QSslSocket>
 #include <QObject>
 #include "jpegstrategy.h"
+#include "jpegservice.h"
 
+// Every socket gets the server's sslConfiguration(). Session resumption is
+// not supported: Qt builds a separate TLS context per socket, and its public
+// API offers no way to share a context, session cache or ticket key between
+// them, so a session or ticket from one connection is unknown to the next.
+// Every handshake is a full one; jpeg_tls_handshake_seconds shows their cost.
 class JPEGSslServer : public QSslServer {
     Q_OBJECT
 public:
     explicit JPEGSslServer(QObject* parent = nullptr);
     void setStrategy(JPEGStrategy* strategy);
+    void setThreadCount(int count);
     void setImagePath(const QString& path);
+    void setCacheSize(qint64 bytes);
+    void setVariantCache(qint64 memoryBytes, const QString& directory, qint64 diskBytes);
+    void setKeepAlive(int idleTimeoutMs, int maxRequests);
+    void setRequestTimeout(int timeoutMs);
+    void setMaxUploadSize(qint64 bytes);
+    const ResponseCache& cache();
 protected:
     void incomingConnection(qintptr socketDescriptor) override;
 private:
-    JPEGStrategy* strategy;
-    QString imagePath;
+    void handleConnection(qintptr socketDescriptor, int worker);
+
+    JPEGService service;
 };
 
 #endif // JPEGSERVER_SECURE_H
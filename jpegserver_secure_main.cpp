@@ -1,6 +1,11 @@
 #include <QCoreApplication>
 #include <QCommandLineParser>
 #include <QDebug>
+#include <QFile>
+#include <QSslCertificate>
+#include <QSslConfiguration>
+#include <QSslKey>
+#include <QThread>
 #include <QtNetwork/QHostAddress>
 #include "jpegserver_secure.h"
 #include "jpegstrategy.h"
@@ -11,35 +16,98 @@ int main(int argc, char *argv[])
     QCommandLineParser parser;
     parser.setApplicationDescription("JPEG Secure Server (SSL/GOST)");
     parser.addHelpOption();
-    parser.addPositionalArgument("file", "Path to JPEG file to serve.");
+    parser.addPositionalArgument("path", "JPEG file to serve, or a directory of JPEG files served by request path.");
     QCommandLineOption portOpt({"p", "port"}, "Port to listen on.", "port", "12345");
     QCommandLineOption progressiveOpt({"g", "progressive"}, "Serve as progressive JPEG.");
+    QCommandLineOption cacheSizeOpt({"c", "cache-size"}, "Encoded response cache size in MiB (0 disables).", "mib", "64");
+    QCommandLineOption variantCacheOpt("variant-cache", "Memory cache for scaled variants (?w=&h=&q=) in MiB.", "mib", "32");
+    QCommandLineOption variantDiskOpt("variant-disk-cache", "Disk cache for scaled variants in MiB (0 disables).", "mib", "512");
+    QCommandLineOption variantDirOpt("variant-dir", "Directory of the variant disk cache; the disk tier is off without it.", "dir");
+    QCommandLineOption threadsOpt({"t", "threads"}, "Number of worker threads (0 handles connections on the main thread).",
+                                  "count", QString::number(QThread::idealThreadCount()));
+    QCommandLineOption keepAliveOpt({"k", "keep-alive"}, "Idle timeout for persistent connections in seconds (0 disables keep-alive).", "seconds", "5");
+    QCommandLineOption requestTimeoutOpt("request-timeout", "Time allowed to send a complete request in seconds.", "seconds", "30");
+    QCommandLineOption maxRequestsOpt("max-requests", "Maximum requests served per connection.", "count", "100");
+    QCommandLineOption maxBodyOpt("max-body", "Maximum POST body size in MiB.", "mib", "256");
+    QCommandLineOption certOpt("cert", "PEM certificate chain presented to clients.", "file");
+    QCommandLineOption keyOpt("key", "PEM private key of the certificate.", "file");
     parser.addOption(portOpt);
     parser.addOption(progressiveOpt);
+    parser.addOption(cacheSizeOpt);
+    parser.addOption(variantCacheOpt);
+    parser.addOption(variantDiskOpt);
+    parser.addOption(variantDirOpt);
+    parser.addOption(threadsOpt);
+    parser.addOption(keepAliveOpt);
+    parser.addOption(requestTimeoutOpt);
+    parser.addOption(maxRequestsOpt);
+    parser.addOption(maxBodyOpt);
+    parser.addOption(certOpt);
+    parser.addOption(keyOpt);
     parser.process(app);
 
     const QStringList args = parser.positionalArguments();
     if (args.isEmpty()) {
-        qCritical() << "No JPEG file specified.";
+        qCritical() << "No JPEG file or directory specified.";
         return 1;
     }
     QString filePath = args.first();
     int port = parser.value(portOpt).toInt();
     bool progressive = parser.isSet(progressiveOpt);
+    qint64 cacheSize = parser.value(cacheSizeOpt).toLongLong() * 1024 * 1024;
+    qint64 variantCacheSize = parser.value(variantCacheOpt).toLongLong() * 1024 * 1024;
+    qint64 variantDiskSize = parser.value(variantDiskOpt).toLongLong() * 1024 * 1024;
+    QString variantDir = parser.value(variantDirOpt);
+    int threads = parser.value(threadsOpt).toInt();
+    int keepAliveMs = parser.value(keepAliveOpt).toInt() * 1000;
+    int requestTimeoutMs = parser.value(requestTimeoutOpt).toInt() * 1000;
+    int maxRequests = parser.value(maxRequestsOpt).toInt();
+    qint64 maxBody = parser.value(maxBodyOpt).toLongLong() * 1024 * 1024;
 
     JPEGSslServer server;
     server.setImagePath(filePath);
+    server.setCacheSize(cacheSize);
+    server.setVariantCache(variantCacheSize, variantDir, variantDiskSize);
+    server.setThreadCount(threads);
+    server.setKeepAlive(keepAliveMs, maxRequests);
+    server.setRequestTimeout(requestTimeoutMs);
+    server.setMaxUploadSize(maxBody);
     if (progressive)
         server.setStrategy(new ProgressiveJPEGStrategy());
     else
         server.setStrategy(new StandardJPEGStrategy());
     
+
+    QSslConfiguration sslConfig = QSslConfiguration::defaultConfiguration();
+    if (parser.isSet(certOpt)) {
+        const QList<QSslCertificate> chain = QSslCertificate::fromPath(parser.value(certOpt), QSsl::Pem);
+        QFile keyFile(parser.value(keyOpt));
+        if (chain.isEmpty() || !keyFile.open(QIODevice::ReadOnly)) {
+            qCritical() << "Failed to read certificate or key";
+            return 1;
+        }
+        const QByteArray keyData = keyFile.readAll();
+        QSslKey key(keyData, QSsl::Rsa, QSsl::Pem);
+        if (key.isNull()) {
+            key = QSslKey(keyData, QSsl::Ec, QSsl::Pem);
+        }
+        if (key.isNull()) {
+            qCritical() << "Unsupported private key:" << parser.value(keyOpt);
+            return 1;
+        }
+        sslConfig.setLocalCertificateChain(chain);
+        sslConfig.setPrivateKey(key);
+    } else {
+        qWarning() << "No --cert/--key given; TLS handshakes will fail.";
+    }
+    server.setSslConfiguration(sslConfig);
+
     if (!server.listen(QHostAddress::Any, port)) {
         qCritical() << "Secure server failed to start on port" << port;
         return 1;
     }
     
-    qDebug() << "JPEG secure server started on port" << port << ", file:" << filePath << (progressive ? "(progressive)" : "(standard)");
+    qDebug() << "JPEG secure server started on port" << port << ", path:" << filePath << (progressive ? "(progressive)" : "(standard)");
     qDebug() << "Note: This is a demonstration of SSL/TLS encryption.";
     qDebug() << "For GOST encryption, additional configuration is required (see code comments).";
     
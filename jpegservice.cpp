@@ -0,0 +1,147 @@
+#include "jpegservice.h"
+#include "imageindex.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QDebug>
+
+JPEGService::JPEGService()
+    : strategy(nullptr), index(nullptr), variants(32 * 1024 * 1024), passthrough(false), idleTimeoutMs(5000), maxRequests(100),
+      requestTimeoutMs(30000), maxUpload(256 * 1024 * 1024) {}
+
+JPEGService::~JPEGService() {
+    workerPool.stop();
+    qDeleteAll(workerStrategies);
+    delete index;
+}
+
+void JPEGService::setStrategy(JPEGStrategy* s) {
+    strategy = s;
+    qDeleteAll(workerStrategies);
+    workerStrategies.fill(nullptr);
+}
+
+void JPEGService::setThreadCount(int count) {
+    qDeleteAll(workerStrategies);
+    workerStrategies = QVector<JPEGStrategy*>(qMax(0, count), nullptr);
+    workerPool.start(qMax(0, count));
+}
+
+void JPEGService::setImagePath(const QString& path) {
+    servedPath = path;
+    if (QFileInfo(path).isDir()) {
+        if (!index) {
+            index = new ImageIndex();
+        }
+        index->build(path);
+    } else {
+        delete index;
+        index = nullptr;
+    }
+}
+
+void JPEGService::setCacheSize(qint64 bytes) {
+    responseCache.setMaxBytes(bytes);
+}
+
+void JPEGService::setVariantCache(qint64 memoryBytes, const QString& directory, qint64 diskBytes) {
+    variants.setMaxBytes(memoryBytes);
+    variants.setDiskCache(directory, diskBytes);
+}
+
+void JPEGService::setPassthrough(bool enabled) {
+    passthrough = enabled;
+}
+
+void JPEGService::setKeepAlive(int timeoutMs, int requests) {
+    idleTimeoutMs = qMax(0, timeoutMs);
+    maxRequests = qMax(1, requests);
+}
+
+void JPEGService::setRequestTimeout(int timeoutMs) {
+    requestTimeoutMs = qMax(1000, timeoutMs);
+}
+
+void JPEGService::setMaxUploadSize(qint64 bytes) {
+    maxUpload = qMax<qint64>(0, bytes);
+}
+
+JPEGStrategy* JPEGService::threadStrategy(int worker) {
+    if (worker < 0 || worker >= workerStrategies.size() || !strategy) {
+        return strategy;
+    }
+    // Each slot is only touched from its own worker thread.
+    JPEGStrategy*& local = workerStrategies[worker];
+    if (!local) {
+        local = strategy->clone();
+    }
+    return local;
+}
+
+bool JPEGService::isPassthroughValid(const QString& path) {
+    const QString key = ResponseCache::makeKey(path, "passthrough");
+    if (key.isEmpty()) {
+        return false;
+    }
+    QMutexLocker locker(&passthroughLock);
+    auto it = validatedFiles.constFind(path);
+    if (it != validatedFiles.constEnd() && it.value().first == key) {
+        return it.value().second;
+    }
+
+    // Header-only check: SOI marker plus a JPEG header Qt can parse.
+    bool valid = false;
+    QFile file(path);
+    if (file.open(QIODevice::ReadOnly)) {
+        valid = file.read(2) == QByteArray("\xFF\xD8", 2);
+        file.close();
+    }
+    if (valid) {
+        QImageReader reader(path);
+        valid = reader.format() == "jpeg" && reader.size().isValid();
+    }
+    if (!valid) {
+        qWarning() << "Passthrough disabled for" << path << "- not a valid JPEG file";
+    }
+    validatedFiles.insert(path, qMakePair(key, valid));
+    return valid;
+}
+
+QString JPEGService::resolveImage(const QByteArray& target) const {
+    if (!index) {
+        return servedPath;
+    }
+    ImageIndexEntry entry;
+    if (!index->lookup(ImageIndex::keyForRequestPath(target), entry)) {
+        return QString();
+    }
+    return entry.filePath;
+}
+
+QString JPEGService::uploadPath(const QByteArray& target) const {
+    if (!index) {
+        return servedPath;
+    }
+    const QString key = ImageIndex::keyForRequestPath(target);
+    if (key.isEmpty()) {
+        return QString();
+    }
+    // Uploads may add images but not create directories.
+    const QString path = index->filePathForKey(key);
+    return QFileInfo(path).dir().exists() ? path : QString();
+}
+
+void JPEGService::imageUploaded(const QString& path) {
+    if (index) {
+        index->refreshFile(path);
+    }
+}
+
+void JPEGService::dispatch(const std::function<void(int)>& task) {
+    workerPool.dispatch(task);
+}
+
+void JPEGService::release(int worker) {
+    workerPool.release(worker);
+}
@@ -0,0 +1,84 @@
+#ifndef JPEGSERVICE_H
+#define JPEGSERVICE_H
+
+#include <QHash>
+#include <QMutex>
+#include <QPair>
+#include <QString>
+#include <QVector>
+#include <functional>
+#include "jpegstrategy.h"
+#include "responsecache.h"
+#include "servermetrics.h"
+#include "serverthreadpool.h"
+
+class ImageIndex;
+
+// State shared by every connection of one server (plain or TLS): what is
+// served, the response cache, worker threads, connection limits and metrics.
+// The image path is either a single file, served for every GET, or a
+// directory whose JPEG files are served by request path (catalog mode).
+class JPEGService {
+public:
+    JPEGService();
+    ~JPEGService();
+
+    void setStrategy(JPEGStrategy* strategy);
+    void setThreadCount(int count);
+    void setImagePath(const QString& path);
+    void setCacheSize(qint64 bytes);
+    // Scaled / re-encoded variants (?w=&h=&q=): memory tier plus an optional
+    // disk tier in the given directory.
+    void setVariantCache(qint64 memoryBytes, const QString& directory, qint64 diskBytes);
+    void setPassthrough(bool enabled);
+    void setKeepAlive(int idleTimeoutMs, int maxRequests);
+    // Time a client has to send a complete request, header and body, from
+    // its first byte; independent of the keep-alive timeout between requests.
+    void setRequestTimeout(int timeoutMs);
+    void setMaxUploadSize(qint64 bytes);
+
+    QString imagePath() const { return servedPath; }
+    bool isCatalog() const { return index != nullptr; }
+    bool passthroughEnabled() const { return passthrough; }
+    int keepAliveTimeout() const { return idleTimeoutMs; }
+    int maxRequestsPerConnection() const { return maxRequests; }
+    int requestTimeout() const { return requestTimeoutMs; }
+    qint64 maxUploadSize() const { return maxUpload; }
+    ResponseCache& cache() { return responseCache; }
+    ResponseCache& variantCache() { return variants; }
+    QMutex& uploadLock() { return uploadMutex; }
+    ServerMetrics& metrics() { return serverMetrics; }
+
+    // Strategy instance owned by the given worker thread (-1: main thread).
+    JPEGStrategy* threadStrategy(int worker);
+    bool isPassthroughValid(const QString& path);
+
+    // File to serve for a request target; empty if there is none.
+    QString resolveImage(const QByteArray& target) const;
+    // File a POST to the target replaces; empty if the target is not allowed.
+    QString uploadPath(const QByteArray& target) const;
+    void imageUploaded(const QString& path);
+
+    void dispatch(const std::function<void(int)>& task);
+    void release(int worker);
+
+private:
+    JPEGStrategy* strategy;
+    QString servedPath;
+    ImageIndex* index;
+    ResponseCache responseCache;
+    ResponseCache variants;
+    ServerMetrics serverMetrics;
+    ServerThreadPool workerPool;
+    QVector<JPEGStrategy*> workerStrategies;
+    QMutex uploadMutex;
+    bool passthrough;
+    QMutex passthroughLock;
+    QHash<QString, QPair<QString, bool>> validatedFiles;
+    int idleTimeoutMs;
+    int maxRequests;
+    int requestTimeoutMs;
+    qint64 maxUpload;
+};
+
+#endif // JPEGSERVICE_H
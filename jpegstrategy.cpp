@@ -1,8 +1,10 @@
 #include "jpegstrategy.h"
+#include "jpegencoder.h"
+#include "boxblur.h"
 #include <QtGui/QImageReader>
 #include <QtGui/QImageWriter>
-#include <QtGui/QColor>
 #include <QtGui/QRgb>
+#include <QtGui/QTransform>
 #include <QtCore/QDebug>
 #include <QtCore/QVariant>
 #include <QtCore/QMap>
@@ -11,9 +13,62 @@
 #include <QtCore/QFileInfo>
 #include <QtCore/QtGlobal>
 
-bool StandardJPEGStrategy::loadImage(const QString& filename, QImage& image) {
+namespace {
+
+// What QImageReader::setAutoTransform(true) does to a decoded image.
+QImage applyOrientation(const QImage& image, QImageIOHandler::Transformations orientation) {
+    if (orientation == QImageIOHandler::TransformationNone) {
+        return image;
+    }
+    QImage result = image.mirrored(orientation & QImageIOHandler::TransformationMirror,
+                                   orientation & QImageIOHandler::TransformationFlip);
+    if (orientation & QImageIOHandler::TransformationRotate90) {
+        result = result.transformed(QTransform().rotate(90));
+    }
+    return result;
+}
+
+}
+
+bool JPEGStrategy::loadImageScaled(const QString& filename, const QSize& targetSize, QImage& image) {
     QImageReader reader(filename);
     reader.setAutoTransform(true);
+    const QSize size = reader.size();
+    if (!size.isValid()) {
+        return false;
+    }
+
+    // The scaled size applies to the stored image, before EXIF rotation.
+    QSize target = targetSize;
+    if (reader.transformation() & QImageIOHandler::TransformationRotate90) {
+        target.transpose();
+    }
+    const QSize bounds(target.width() > 0 ? target.width() : size.width(),
+                       target.height() > 0 ? target.height() : size.height());
+    if (size.width() > bounds.width() || size.height() > bounds.height()) {
+        reader.setScaledSize(size.scaled(bounds, Qt::KeepAspectRatio).expandedTo(QSize(1, 1)));
+    }
+    image = reader.read();
+    return !image.isNull();
+}
+
+bool JPEGStrategy::loadFullImage(const QString& filename, QImage& image) {
+    QImageReader reader(filename);
+    reader.setAutoTransform(true);
+    if (cancelCheck) {
+        // Latest-only outputs just the final scan of a progressive file.
+        JPEGScanDecoder decoder;
+        decoder.setLatestScanOnly(true);
+        decoder.setCancelCheck(cancelCheck);
+        if (decoder.openFile(filename) && decoder.decodeNextScan(image) == JPEGScanDecoder::ScanReady) {
+            image = applyOrientation(image, reader.transformation());
+            return true;
+        }
+        // Anything the scan decoder does not support (CMYK) goes to Qt.
+        if (isCancelled()) {
+            return false;
+        }
+    }
     if (reader.canRead()) {
         image = reader.read();
         return !image.isNull();
@@ -21,63 +76,106 @@ bool StandardJPEGStrategy::loadImage(const QString& filename, QImage& image) {
     return false;
 }
 
+bool StandardJPEGStrategy::loadImage(const QString& filename, QImage& image) {
+    return loadFullImage(filename, image);
+}
+
 bool StandardJPEGStrategy::saveImage(const QString& filename, const QImage& image, 
-                                     int quality, bool progressive, int dctMethod) {
-    
-    Q_UNUSED(progressive);
-    Q_UNUSED(dctMethod);
-    
-    return image.save(filename, "JPEG", quality);
+                                     int quality, bool progressive, int dctMethod, int subsampling) {
+    JPEGEncoder::Options options;
+    options.quality = quality;
+    options.progressive = progressive;
+    options.dctMethod = dctMethod;
+    options.subsampling = subsampling;
+    return JPEGEncoder::save(filename, image, options);
 }
 
 bool ProgressiveJPEGStrategy::loadImage(const QString& filename, QImage& image) {
     currentFilename = filename;
     currentScan = 0;
-    
+    isProgressive = false;
+
     QImageReader reader(filename);
     reader.setAutoTransform(true);
-    
+
+    // libjpeg decides from the header, however large its APPn segments:
+    // files with several scans are decoded scan by scan, the rest keep the
+    // blur emulation below.
+    realScans = false;
+    decoder.reset();
+    decoder.setCancelCheck(cancelCheck);
     QFile file(filename);
-    isProgressive = false;
     if (file.open(QFile::ReadOnly)) {
-        QByteArray header = file.read(2048);
-        for (int i = 0; i < header.size() - 1; ++i) {
-            if (static_cast<unsigned char>(header[i]) == 0xFF && 
-                static_cast<unsigned char>(header[i+1]) == 0xC2) {
+        while (!decoder.readHeader() && decoder.hasMoreScans() && !file.atEnd()) {
+            decoder.appendData(file.read(HeaderChunkSize));
+        }
+        if (decoder.isProgressive()) {
+            decoder.appendData(file.readAll());
+            decoder.setComplete();
+            orientation = reader.transformation();
+            if (decoder.decodeNextScan(image) == JPEGScanDecoder::ScanReady) {
+                realScans = true;
                 isProgressive = true;
-                break;
+                originalImage = QImage();
+                currentScan = 1;
+                image = applyOrientation(image, orientation);
+                return true;
             }
         }
         file.close();
     }
-    
+    decoder.reset();
+
     QByteArray format = reader.format();
-    if (format == "jpeg" || format == "jpg") {
-        if (reader.canRead()) {
-            originalImage = reader.read();
-            if (!originalImage.isNull()) {
-                if (!isProgressive) {
-                    isProgressive = true;
-                }
-                
-                if (originalImage.format() != QImage::Format_RGB32 &&
-                    originalImage.format() != QImage::Format_ARGB32) {
-                    originalImage = originalImage.convertToFormat(QImage::Format_RGB32);
-                }
+    if (format != "jpeg" && format != "jpg") {
+        return false;
+    }
+    QSize fullSize = reader.size();
+    if (reader.transformation() & QImageIOHandler::TransformationRotate90) {
+        fullSize.transpose();
+    }
 
-                currentScan = 1;
-                image = applyBlur(originalImage, 8);
-                
-                return true;
-            }
-        }
+    // The coarsest scan only needs a DCT-scaled decode; the full image is
+    // decoded once the second scan is asked for.
+    QImage preview;
+    if (!fullSize.isValid()
+            || !loadImageScaled(filename, fullSize / EmulatedFirstScanDenominator, preview)) {
+        return false;
     }
-    
-    return false;
+    isProgressive = true;
+    originalImage = QImage();
+    currentScan = 1;
+    image = preview.scaled(fullSize, Qt::IgnoreAspectRatio, Qt::SmoothTransformation)
+                   .convertToFormat(QImage::Format_RGB32);
+    return true;
+}
+
+bool ProgressiveJPEGStrategy::loadOriginal() {
+    if (!loadFullImage(currentFilename, originalImage)) {
+        originalImage = QImage();
+        return false;
+    }
+    if (originalImage.format() != QImage::Format_RGB32 &&
+        originalImage.format() != QImage::Format_ARGB32) {
+        originalImage = originalImage.convertToFormat(QImage::Format_RGB32);
+    }
+    return true;
 }
 
 bool ProgressiveJPEGStrategy::loadNextScan(QImage& image) {
-    if (!isProgressive || currentFilename.isEmpty() || originalImage.isNull()) {
+    if (realScans) {
+        if (decoder.decodeNextScan(image) != JPEGScanDecoder::ScanReady) {
+            return false;
+        }
+        image = applyOrientation(image, orientation);
+        currentScan++;
+        return true;
+    }
+
+    if (!isProgressive || currentFilename.isEmpty() || isCancelled()) {
+        return false;
+    }
+    if (originalImage.isNull() && !loadOriginal()) {
         return false;
     }
     
@@ -86,7 +184,7 @@ bool ProgressiveJPEGStrategy::loadNextScan(QImage& image) {
     int blurRadius = qMax(0, 8 - (currentScan - 1) * 2);
     
     if (blurRadius > 0) {
-        image = applyBlur(originalImage, blurRadius);
+        image = BoxBlur::blockBlur(originalImage, blurRadius);
     } else {
         image = originalImage;
     }
@@ -95,7 +193,10 @@ bool ProgressiveJPEGStrategy::loadNextScan(QImage& image) {
 }
 
 bool ProgressiveJPEGStrategy::hasMoreScans() const {
-    if (!currentFilename.isEmpty() && isProgressive && currentScan < 5) {
+    if (realScans) {
+        return decoder.hasMoreScans();
+    }
+    if (!currentFilename.isEmpty() && isProgressive && currentScan < EmulatedScanCount) {
         return true;
     }
     return false;
@@ -105,60 +206,25 @@ void ProgressiveJPEGStrategy::reset() {
     currentFilename.clear();
     currentScan = 0;
     isProgressive = false;
+    realScans = false;
+    orientation = QImageIOHandler::TransformationNone;
+    decoder.reset();
     originalImage = QImage();
 }
 
-QImage ProgressiveJPEGStrategy::applyBlur(const QImage& image, int radius) {
-    if (radius <= 0 || image.isNull()) {
-        return image;
-    }
-
-    QImage result = QImage(image.size(), image.format());
-    
-    int step = qMax(1, radius / 2);
-    
-    for (int y = 0; y < result.height(); y += step) {
-        for (int x = 0; x < result.width(); x += step) {
-            int r = 0, g = 0, b = 0, count = 0;
-            
-            int yStart = qMax(0, y - radius);
-            int yEnd = qMin(result.height() - 1, y + radius);
-            int xStart = qMax(0, x - radius);
-            int xEnd = qMin(result.width() - 1, x + radius);
-            
-            for (int py = yStart; py <= yEnd; py++) {
-                for (int px = xStart; px <= xEnd; px++) {
-                    QColor c = image.pixelColor(px, py);
-                    r += c.red();
-                    g += c.green();
-                    b += c.blue();
-                    count++;
-                }
-            }
-            
-            if (count > 0) {
-                r /= count;
-                g /= count;
-                b /= count;
-                QColor avgColor(r, g, b);
-                
-                for (int py = y; py < qMin(result.height(), y + step); py++) {
-                    for (int px = x; px < qMin(result.width(), x + step); px++) {
-                        result.setPixelColor(px, py, avgColor);
-                    }
-                }
-            }
-        }
+int ProgressiveJPEGStrategy::scanCount() const {
+    if (realScans) {
+        return decoder.scansInInput();
     }
-    
-    return result;
+    return isProgressive ? EmulatedScanCount : 0;
 }
 
 bool ProgressiveJPEGStrategy::saveImage(const QString& filename, const QImage& image, 
-                                        int quality, bool progressive, int dctMethod) {
-    
-    Q_UNUSED(progressive);
-    Q_UNUSED(dctMethod);
-    
-    return image.save(filename, "JPEG", quality);
+                                        int quality, bool progressive, int dctMethod, int subsampling) {
+    JPEGEncoder::Options options;
+    options.quality = quality;
+    options.progressive = progressive;
+    options.dctMethod = dctMethod;
+    options.subsampling = subsampling;
+    return JPEGEncoder::save(filename, image, options);
 }
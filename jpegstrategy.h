@@ -2,28 +2,61 @@
 #define JPEGSTRATEGY_H
 
 #include <QImage>
+#include <QImageIOHandler>
+#include <QSize>
 #include <QString>
+#include <functional>
+#include "jpegscandecoder.h"
 
 class JPEGStrategy {
 public:
     virtual ~JPEGStrategy() = default;
     virtual bool loadImage(const QString& filename, QImage& image) = 0;
+    // Full image fitted inside targetSize (aspect kept, never upscaled; a
+    // dimension <= 0 is unconstrained). libjpeg does most of the reduction
+    // in the DCT domain, decoding at 1/2, 1/4 or 1/8 size.
+    virtual bool loadImageScaled(const QString& filename, const QSize& targetSize, QImage& image);
     virtual bool saveImage(const QString& filename, const QImage& image, 
-                          int quality, bool progressive, int dctMethod) = 0;
+                          int quality, bool progressive, int dctMethod, int subsampling) = 0;
+    virtual QString name() const = 0;
+    // Fresh instance of the same strategy, e.g. one per server worker thread.
+    virtual JPEGStrategy* clone() const = 0;
+    // Polled during decoding; once it returns true the load stops early and
+    // fails. Not copied by clone().
+    void setCancelCheck(const std::function<bool()>& cancelled) { cancelCheck = cancelled; }
+
+protected:
+    bool isCancelled() const { return cancelCheck && cancelCheck(); }
+    // The whole image with EXIF orientation applied: by QImageReader, or
+    // with a cancel check set, by JPEGScanDecoder so it can stop mid-decode.
+    bool loadFullImage(const QString& filename, QImage& image);
+
+    std::function<bool()> cancelCheck;
 };
 
 class StandardJPEGStrategy : public JPEGStrategy {
 public:
     bool loadImage(const QString& filename, QImage& image) override;
     bool saveImage(const QString& filename, const QImage& image, 
-                  int quality, bool progressive, int dctMethod) override;
+                  int quality, bool progressive, int dctMethod, int subsampling) override;
+    QString name() const override { return "standard"; }
+    JPEGStrategy* clone() const override { return new StandardJPEGStrategy(); }
 };
 
 class ProgressiveJPEGStrategy : public JPEGStrategy {
 public:
     bool loadImage(const QString& filename, QImage& image) override;
     bool saveImage(const QString& filename, const QImage& image, 
-                  int quality, bool progressive, int dctMethod) override;
+                  int quality, bool progressive, int dctMethod, int subsampling) override;
+    QString name() const override { return "progressive"; }
+    JPEGStrategy* clone() const override { return new ProgressiveJPEGStrategy(); }
+
+    // Scans emulated by blurring when the file itself is baseline.
+    static const int EmulatedScanCount = 5;
+    // The first emulated scan is decoded at 1/8 size, like a DC-only scan.
+    static const int EmulatedFirstScanDenominator = 8;
+    // Scans loadImage() + loadNextScan() produce for the loaded file.
+    int scanCount() const;
 
     bool loadNextScan(QImage& image);
 
@@ -35,9 +68,16 @@ private:
     QString currentFilename;
     int currentScan = 0;
     bool isProgressive = false;
+    bool realScans = false;
+    // EXIF orientation, applied to real scans like setAutoTransform() does.
+    QImageIOHandler::Transformations orientation = QImageIOHandler::TransformationNone;
+    JPEGScanDecoder decoder;
     QImage originalImage;
 
-    QImage applyBlur(const QImage& image, int radius);
+    // Read until the header is in; APPn segments can take up to 64 KB each.
+    static const qint64 HeaderChunkSize = 64 * 1024;
+
+    bool loadOriginal();
 };
 
 #endif // JPEGSTRATEGY_H
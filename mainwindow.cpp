@@ -2,19 +2,32 @@
 #include <QtWidgets/QApplication>
 #include <QtCore/QFileInfo>
 #include <QtCore/QTimer>
+#include <QtCore/QEvent>
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
     , imageHandler(nullptr)
-    , loadCommand(nullptr)
+    , imageLoader(nullptr)
+    , scanPyramid(nullptr)
+    , shownScan(0)
+    , advancePending(false)
     , networkClient(nullptr)
     , networkSslClient(nullptr)
+    , downloadClient(nullptr)
+    , downloadId(0)
     , serverManager(nullptr)
 {
     imageHandler = ImageHandler::createHandler(ImageHandler::Progressive);
     serverManager = new ServerManager(this);
     networkClient = new JPEGClient(this);
     networkSslClient = new JPEGSslClient(this);
+    // Created before the pyramid so it is destroyed first: its destructor
+    // waits for a load that may still be adding scans.
+    imageLoader = new AsyncImageLoader(this, this);
+    scanPyramid = new ScanPyramid(this);
+    imageLoader->setScanPyramid(scanPyramid);
+    autoAdvanceTimer = new QTimer(this);
+    autoAdvanceTimer->setInterval(AutoAdvanceIntervalMs);
     
     setupUI();
 }
@@ -22,7 +35,6 @@ MainWindow::MainWindow(QWidget *parent)
 MainWindow::~MainWindow()
 {
     delete imageHandler;
-    delete loadCommand;
     if (serverManager) {
         serverManager->stopServer();
     }
@@ -48,6 +60,8 @@ void MainWindow::setupUI()
     nextScanButton = new QPushButton(">", this);
     nextScanButton->setEnabled(false);
     nextScanButton->setMaximumWidth(50);
+    autoAdvanceCheckBox = new QCheckBox("Auto", this);
+    autoAdvanceCheckBox->setToolTip("Step through the scans automatically");
 
     // Network controls
     buttonLayout->addWidget(new QLabel("Client Mode:", this));
@@ -65,6 +79,12 @@ void MainWindow::setupUI()
     portEdit->setPlaceholderText("Port");
     portEdit->setFixedWidth(60);
     portEdit->setText("12345");
+    // Parallel range requests for large downloads.
+    connectionsSpinBox = new QSpinBox(this);
+    connectionsSpinBox->setRange(1, 8);
+    connectionsSpinBox->setValue(1);
+    connectionsSpinBox->setPrefix("x");
+    connectionsSpinBox->setToolTip("Connections per download");
 
     buttonLayout->addWidget(loadButton);
     buttonLayout->addWidget(saveButton);
@@ -72,9 +92,11 @@ void MainWindow::setupUI()
     uploadButton = new QPushButton("Upload to Server", this);
     uploadButton->setFixedWidth(140);
     buttonLayout->addWidget(nextScanButton);
+    buttonLayout->addWidget(autoAdvanceCheckBox);
     buttonLayout->addSpacing(20);
     buttonLayout->addWidget(ipEdit);
     buttonLayout->addWidget(portEdit);
+    buttonLayout->addWidget(connectionsSpinBox);
     buttonLayout->addWidget(networkLoadButton);
     buttonLayout->addWidget(uploadButton);
     buttonLayout->addStretch();
@@ -87,6 +109,7 @@ void MainWindow::setupUI()
     imageLabel->setMinimumSize(1000, 700);
     imageLabel->setText("No image loaded");
     imageLabel->setScaledContents(false);
+    imageLabel->installEventFilter(this);
     mainLayout->addWidget(imageLabel);
 
     QHBoxLayout* saveOptionsLayout = new QHBoxLayout();
@@ -101,6 +124,13 @@ void MainWindow::setupUI()
     dctComboBox->addItem("Float", 2);
     saveOptionsLayout->addWidget(dctComboBox);
     
+    saveOptionsLayout->addWidget(new QLabel("Chroma:", this));
+    subsamplingComboBox = new QComboBox(this);
+    subsamplingComboBox->addItem("4:2:0", 0);
+    subsamplingComboBox->addItem("4:2:2", 1);
+    subsamplingComboBox->addItem("4:4:4", 2);
+    saveOptionsLayout->addWidget(subsamplingComboBox);
+    
     saveOptionsLayout->addWidget(new QLabel("Quality:", this));
     qualitySlider = new QSlider(Qt::Horizontal, this);
     qualitySlider->setRange(0, 100);
@@ -166,6 +196,10 @@ void MainWindow::setupUI()
     connect(loadButton, &QPushButton::clicked, this, &MainWindow::onLoadButtonClicked);
     connect(saveButton, &QPushButton::clicked, this, &MainWindow::onSaveButtonClicked);
     connect(nextScanButton, &QPushButton::clicked, this, &MainWindow::onNextScanButtonClicked);
+    connect(autoAdvanceCheckBox, &QCheckBox::toggled, this, &MainWindow::onAutoAdvanceToggled);
+    connect(autoAdvanceTimer, &QTimer::timeout, this, &MainWindow::onAutoAdvanceTimeout);
+    connect(scanPyramid, &ScanPyramid::scanReady, this, &MainWindow::onScanReady);
+    connect(scanPyramid, &ScanPyramid::finished, this, &MainWindow::onScanPyramidFinished);
     connect(qualitySlider, &QSlider::valueChanged, this, &MainWindow::onQualityChanged);
     connect(qualitySpinBox, QOverload<int>::of(&QSpinBox::valueChanged), 
             qualitySlider, &QSlider::setValue);
@@ -174,12 +208,13 @@ void MainWindow::setupUI()
 
     // Network clients connections
     connect(networkLoadButton, &QPushButton::clicked, this, &MainWindow::onNetworkLoadButtonClicked);
-    connect(networkClient, &JPEGClient::imageReceived, this, &MainWindow::onNetworkImageReceived);
-    connect(networkClient, &JPEGClient::errorOccurred, this, &MainWindow::onNetworkError);
-    connect(networkClient, &JPEGClient::uploadFinished, this, &MainWindow::onUploadFinished);
-    connect(networkSslClient, &JPEGSslClient::imageReceived, this, &MainWindow::onNetworkImageReceived);
-    connect(networkSslClient, &JPEGSslClient::errorOccurred, this, &MainWindow::onNetworkError);
-    connect(networkSslClient, &JPEGSslClient::uploadFinished, this, &MainWindow::onUploadFinished);
+    for (JPEGClient* client : { networkClient, static_cast<JPEGClient*>(networkSslClient) }) {
+        connect(client, &JPEGClient::imageReceived, this, &MainWindow::onNetworkImageReceived);
+        connect(client, &JPEGClient::partialImageReceived, this, &MainWindow::onNetworkImageReceived);
+        connect(client, &JPEGClient::downloadFinished, this, &MainWindow::onNetworkDownloadFinished);
+        connect(client, &JPEGClient::uploadProgress, this, &MainWindow::onUploadProgress);
+        connect(client, &JPEGClient::uploadFinished, this, &MainWindow::onUploadFinished);
+    }
     connect(uploadButton, &QPushButton::clicked, this, &MainWindow::onUploadButtonClicked);
 
     // Server manager connections
@@ -204,24 +239,46 @@ void MainWindow::onNetworkLoadButtonClicked()
     bool secureMode = (clientModeComboBox->currentData().toInt() == 1);
     statusBar()->showMessage(QString("Connecting to %1 server...").arg(secureMode ? "secure" : "normal"), 2000);
     
-    if (secureMode) {
-        networkSslClient->getImage(ip, port);
-    } else {
-        networkClient->getImage(ip, port);
+    // Only the newest download is shown; an older one still running is
+    // dropped (forgotten first, so its abort is not reported as an error).
+    JPEGClient* previousClient = downloadClient;
+    const int previousId = downloadId;
+    downloadClient = nullptr;
+    downloadId = 0;
+    if (previousClient) {
+        previousClient->abort(previousId);
     }
+    downloadClient = secureMode ? networkSslClient : networkClient;
+    downloadId = downloadClient->getImage(ip, port, connectionsSpinBox->value());
 }
 
-void MainWindow::onNetworkImageReceived(const QImage& image)
+void MainWindow::onNetworkImageReceived(int requestId, const QImage& image)
 {
+    if (sender() != downloadClient || requestId != downloadId) {
+        return;
+    }
+    imageLoader->cancel();
+    scanPyramid->cancel();
+    advancePending = false;
+    updateNextScanButton();
     currentImage = image;
     updateImageDisplay(image);
     statusBar()->showMessage("Image received from server", 2000);
 }
 
-void MainWindow::onNetworkError(const QString& error)
+void MainWindow::onNetworkDownloadFinished(int requestId, bool success, const QString& message)
 {
-    QMessageBox::critical(this, "Network error", error);
-    statusBar()->showMessage("Network error", 2000);
+    if (sender() != downloadClient || requestId != downloadId) {
+        return;
+    }
+    downloadClient = nullptr;
+    downloadId = 0;
+    if (success) {
+        statusBar()->showMessage(message, 2000);
+    } else {
+        QMessageBox::critical(this, "Network error", message);
+        statusBar()->showMessage("Network error", 2000);
+    }
 }
 
 void MainWindow::onLoadButtonClicked()
@@ -233,21 +290,12 @@ void MainWindow::onLoadButtonClicked()
         return;
     }
 
-    QFileInfo fileInfo(filename);
-    ImageHandler::HandlerType handlerType = ImageHandler::Progressive;
-
-    if (imageHandler) {
-        delete imageHandler;
-    }
-    imageHandler = ImageHandler::createHandler(handlerType);
-
-    if (loadCommand) {
-        delete loadCommand;
-    }
-    loadCommand = new LoadImageCommand(imageHandler, filename, this);
-    loadCommand->execute();
-    
+    // The previous file's scans are dropped; its load, if still running,
+    // is superseded and never reaches onImageLoaded.
+    advancePending = false;
+    imageLoader->load(ImageHandler::Progressive, filename);
     updateNextScanButton();
+    statusBar()->showMessage(QString("Loading %1...").arg(QFileInfo(filename).fileName()));
 }
 
 void MainWindow::onUploadButtonClicked()
@@ -268,15 +316,19 @@ void MainWindow::onUploadButtonClicked()
     bool secureMode = (clientModeComboBox->currentData().toInt() == 1);
     statusBar()->showMessage(QString("Uploading image to %1 server...").arg(secureMode ? "secure" : "normal"), 2000);
     
-    if (secureMode) {
-        networkSslClient->uploadImage(ip, port, filename);
-    } else {
-        networkClient->uploadImage(ip, port, filename);
-    }
+    JPEGClient* client = secureMode ? networkSslClient : networkClient;
+    client->uploadImage(ip, port, filename);
 }
 
-void MainWindow::onUploadFinished(bool success, const QString& message)
+void MainWindow::onUploadProgress(int requestId, qint64 sent, qint64 total)
 {
+    Q_UNUSED(requestId);
+    statusBar()->showMessage(QString("Uploading... %1 of %2 KB").arg(sent / 1024).arg(total / 1024), 2000);
+}
+
+void MainWindow::onUploadFinished(int requestId, bool success, const QString& message)
+{
+    Q_UNUSED(requestId);
     if (success) {
         statusBar()->showMessage("Upload successful", 3000);
         QMessageBox::information(this, "Upload", message);
@@ -303,9 +355,10 @@ void MainWindow::onSaveButtonClicked()
     int quality = qualitySlider->value();
     bool progressive = progressiveCheckBox->isChecked();
     int dctMethod = dctComboBox->currentData().toInt();
+    int subsampling = subsamplingComboBox->currentData().toInt();
     
     SaveImageCommand saveCommand(imageHandler, filename, currentImage, 
-                                 quality, progressive, dctMethod);
+                                 quality, progressive, dctMethod, subsampling);
     
     if (saveCommand.execute()) {
         QMessageBox::information(this, "Success", "Image saved successfully");
@@ -316,15 +369,61 @@ void MainWindow::onSaveButtonClicked()
 
 void MainWindow::onNextScanButtonClicked()
 {
-    if (loadCommand && loadCommand->canLoadNextScan()) {
-        loadCommand->executeNextScan();
-        updateNextScanButton();
-        statusBar()->showMessage(QString("Loaded next scan. Click '>' to load more."), 2000);
+    if (shownScan + 1 < scanPyramid->count()) {
+        showScan(shownScan + 1);
+    } else if (scanPyramid->isRunning()) {
+        advancePending = true;
+        statusBar()->showMessage("Computing next scan...");
     } else {
         statusBar()->showMessage("No more scans available", 2000);
     }
 }
 
+void MainWindow::onAutoAdvanceToggled(bool enabled)
+{
+    if (enabled) {
+        autoAdvanceTimer->start();
+    } else {
+        autoAdvanceTimer->stop();
+    }
+}
+
+void MainWindow::onAutoAdvanceTimeout()
+{
+    if (shownScan + 1 < scanPyramid->count()) {
+        showScan(shownScan + 1);
+    } else if (!scanPyramid->isRunning()) {
+        autoAdvanceCheckBox->setChecked(false);
+    }
+}
+
+void MainWindow::onScanReady(int index, const QImage& image)
+{
+    Q_UNUSED(image);
+    if (advancePending && index == shownScan + 1) {
+        advancePending = false;
+        showScan(index);
+    }
+    updateNextScanButton();
+}
+
+void MainWindow::onScanPyramidFinished(int count)
+{
+    advancePending = false;
+    statusBar()->showMessage(QString("All %1 scans ready").arg(count), 2000);
+    updateNextScanButton();
+}
+
+void MainWindow::showScan(int index)
+{
+    shownScan = index;
+    currentImage = scanPyramid->takeScan(index);
+    updateImageDisplay(currentImage);
+    updateNextScanButton();
+    statusBar()->showMessage(QString("Scan %1 of %2%3").arg(index + 1).arg(scanPyramid->count())
+                             .arg(scanPyramid->isRunning() ? "+" : ""), 2000);
+}
+
 void MainWindow::onQualityChanged(int value)
 {
     Q_UNUSED(value);
@@ -334,11 +433,16 @@ void MainWindow::onImageLoaded(const QImage& image)
 {
     currentImage = image;
     updateImageDisplay(image);
+    shownScan = 0;
+    advancePending = false;
     updateNextScanButton();
+    statusBar()->showMessage(QString("Loaded %1").arg(QFileInfo(imageLoader->filename()).fileName()), 2000);
 }
 
 void MainWindow::onLoadError(const QString& error)
 {
+    scanPyramid->cancel();
+    advancePending = false;
     QMessageBox::critical(this, "Error", error);
     currentImage = QImage();
     updateImageDisplay(QImage());
@@ -348,32 +452,31 @@ void MainWindow::onLoadError(const QString& error)
 void MainWindow::updateImageDisplay(const QImage& image)
 {
     if (image.isNull()) {
+        displayScaler.clear();
         imageLabel->setText("No image loaded");
         imageLabel->setPixmap(QPixmap());
         return;
     }
     
-    QPixmap pixmap = QPixmap::fromImage(image);
-    QSize labelSize = imageLabel->size();
-    QSize scaledSize = pixmap.size();
-    scaledSize.scale(labelSize, Qt::KeepAspectRatio);
-    
-    if (scaledSize != pixmap.size()) {
-        pixmap = pixmap.scaled(scaledSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
-    }
-    
-    imageLabel->setPixmap(pixmap);
+    const qreal ratio = imageLabel->devicePixelRatioF();
+    const QSize bounds = imageLabel->contentsRect().size() * ratio;
+    imageLabel->setPixmap(displayScaler.pixmap(image, bounds, ratio));
     imageLabel->setText("");
 }
 
-void MainWindow::updateNextScanButton()
+bool MainWindow::eventFilter(QObject* watched, QEvent* event)
 {
-    if (loadCommand && imageHandler) {
-        bool canLoad = loadCommand->canLoadNextScan();
-        nextScanButton->setEnabled(canLoad);
-    } else {
-        nextScanButton->setEnabled(false);
+    if (watched == imageLabel && event->type() == QEvent::Resize && !currentImage.isNull()) {
+        updateImageDisplay(currentImage);
     }
+    return QMainWindow::eventFilter(watched, event);
+}
+
+void MainWindow::updateNextScanButton()
+{
+    // The pyramid of a load runs from its start; scans follow the first image.
+    nextScanButton->setEnabled(!imageLoader->isLoading()
+                               && (shownScan + 1 < scanPyramid->count() || scanPyramid->isRunning()));
 }
 
 void MainWindow::onServerStartButtonClicked()
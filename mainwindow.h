@@ -15,12 +15,15 @@
 #include <QtWidgets/QStatusBar>
 #include <QtWidgets/QLineEdit>
 #include <QtGui/QImage>
+#include <QtCore/QTimer>
 #include "jpegloader.h"
 #include "jpegsaver.h"
 #include "imagehandler.h"
 #include "jpegclient.h"
 #include "jpegclient_secure.h"
 #include "servermanager.h"
+#include "scanpyramid.h"
+#include "imagescaler.h"
 
 class MainWindow : public QMainWindow, public ImageLoadObserver
 {
@@ -34,16 +37,24 @@ public:
     void onImageLoaded(const QImage& image) override;
     void onLoadError(const QString& error) override;
 
+protected:
+    bool eventFilter(QObject* watched, QEvent* event) override;
+
 private slots:
     void onLoadButtonClicked();
     void onSaveButtonClicked();
     void onNextScanButtonClicked();
+    void onAutoAdvanceToggled(bool enabled);
+    void onAutoAdvanceTimeout();
+    void onScanReady(int index, const QImage& image);
+    void onScanPyramidFinished(int count);
     void onQualityChanged(int value);
     void onNetworkLoadButtonClicked();
-    void onNetworkImageReceived(const QImage& image);
-    void onNetworkError(const QString& error);
+    void onNetworkImageReceived(int requestId, const QImage& image);
+    void onNetworkDownloadFinished(int requestId, bool success, const QString& message);
     void onUploadButtonClicked();
-    void onUploadFinished(bool success, const QString& message);
+    void onUploadProgress(int requestId, qint64 sent, qint64 total);
+    void onUploadFinished(int requestId, bool success, const QString& message);
     void onServerStartButtonClicked();
     void onServerStopButtonClicked();
     void onServerImagePathButtonClicked();
@@ -56,13 +67,16 @@ private:
     QPushButton* loadButton;
     QPushButton* saveButton;
     QPushButton* nextScanButton;
+    QCheckBox* autoAdvanceCheckBox;
     QPushButton* networkLoadButton;
     QPushButton* uploadButton;
     QLineEdit* ipEdit;
     QLineEdit* portEdit;
     QComboBox* clientModeComboBox;
+    QSpinBox* connectionsSpinBox;
     QCheckBox* progressiveCheckBox;
     QComboBox* dctComboBox;
+    QComboBox* subsamplingComboBox;
     QSlider* qualitySlider;
     QSpinBox* qualitySpinBox;
 
@@ -77,16 +91,30 @@ private:
     QLabel* serverStatusLabel;
 
     QImage currentImage;
+    // Display-sized pixmaps of currentImage; never the full resolution.
+    ImageScaler displayScaler;
     ImageHandler* imageHandler;
-    LoadImageCommand* loadCommand;
+    AsyncImageLoader* imageLoader;
+
+    // All scans of the loaded file, fed by imageLoader's decode; '>' shows
+    // the next one, or waits for it if it is still being decoded.
+    ScanPyramid* scanPyramid;
+    int shownScan;
+    bool advancePending;
+    QTimer* autoAdvanceTimer;
+    static const int AutoAdvanceIntervalMs = 400;
 
     class JPEGClient* networkClient;
     class JPEGSslClient* networkSslClient;
+    // Client and id of the download being shown; uploads run independently.
+    JPEGClient* downloadClient;
+    int downloadId;
     ServerManager* serverManager;
 
     void setupUI();
     void updateImageDisplay(const QImage& image);
     void updateNextScanButton();
+    void showScan(int index);
     void updateServerControls();
 };
 
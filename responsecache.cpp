@@ -0,0 +1,210 @@
+#include "responsecache.h"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+
+#ifndef Q_OS_WIN
+#include <unistd.h>
+#endif
+
+ResponseCache::ResponseCache(qint64 maxBytes)
+    : cache(maxBytes), hitCount(0), missCount(0), diskMaxBytes(0), diskTotalBytes(0), useCounter(0) {}
+
+QString ResponseCache::makeKey(const QString& path, const QString& strategyName) {
+    QFileInfo info(path);
+    if (!info.exists() || !info.isFile()) {
+        return QString();
+    }
+    return QString("%1|%2|%3|%4")
+        .arg(info.absoluteFilePath())
+        .arg(info.size())
+        .arg(info.lastModified().toMSecsSinceEpoch())
+        .arg(strategyName);
+}
+
+bool ResponseCache::lookup(const QString& key, QByteArray& data) {
+    if (key.isEmpty()) {
+        return false;
+    }
+    QMutexLocker locker(&mutex);
+    QByteArray* cached = cache.object(key);
+    if (cached) {
+        ++hitCount;
+        data = *cached;
+        return true;
+    }
+    locker.unlock();
+
+    if (readDisk(key, data)) {
+        locker.relock();
+        ++hitCount;
+        cache.insert(key, new QByteArray(data), data.size());
+        return true;
+    }
+    locker.relock();
+    ++missCount;
+    return false;
+}
+
+void ResponseCache::insert(const QString& key, const QByteArray& data) {
+    if (key.isEmpty() || data.isEmpty()) {
+        return;
+    }
+    {
+        QMutexLocker locker(&mutex);
+        cache.insert(key, new QByteArray(data), data.size());
+    }
+    writeDisk(key, data);
+}
+
+void ResponseCache::clear() {
+    QMutexLocker locker(&mutex);
+    cache.clear();
+}
+
+void ResponseCache::setMaxBytes(qint64 maxBytes) {
+    QMutexLocker locker(&mutex);
+    cache.setMaxCost(maxBytes);
+}
+
+qint64 ResponseCache::maxBytes() const {
+    QMutexLocker locker(&mutex);
+    return cache.maxCost();
+}
+
+void ResponseCache::setDiskCache(const QString& directory, qint64 maxBytes) {
+    QMutexLocker locker(&mutex);
+    diskEntries.clear();
+    diskOrder.clear();
+    diskTotalBytes = 0;
+    diskDirectory.clear();
+    diskMaxBytes = qMax<qint64>(0, maxBytes);
+    if (directory.isEmpty() || diskMaxBytes == 0) {
+        return;
+    }
+    if (!QFileInfo::exists(directory)) {
+        if (!QDir().mkpath(directory)) {
+            qWarning() << "Cannot create cache directory" << directory;
+            return;
+        }
+        QFile::setPermissions(directory, QFile::ReadOwner | QFile::WriteOwner | QFile::ExeOwner);
+    }
+    // Anyone who can write here can plant a body under a predictable name.
+    const QFileInfo info(directory);
+    if (!info.isDir() || info.permissions().testAnyFlags(QFile::WriteGroup | QFile::WriteOther)
+#ifndef Q_OS_WIN
+            || info.ownerId() != uint(::geteuid())
+#endif
+            ) {
+        qWarning() << "Refusing cache directory" << directory << "- not a directory owned by this user"
+                   << "and writable only by it";
+        return;
+    }
+    diskDirectory = directory;
+
+    const QFileInfoList files = QDir(directory).entryInfoList({"*.jpg"}, QDir::Files, QDir::Time | QDir::Reversed);
+    for (const QFileInfo& file : files) {
+        const DiskEntry entry = { file.size(), ++useCounter };
+        diskEntries.insert(file.fileName(), entry);
+        diskOrder.insert(entry.lastUse, file.fileName());
+        diskTotalBytes += entry.size;
+    }
+    trimDisk();
+    qDebug() << "Disk cache" << directory << "holds" << diskEntries.size() << "entries," << diskTotalBytes << "bytes";
+}
+
+qint64 ResponseCache::diskBytes() const {
+    QMutexLocker locker(&mutex);
+    return diskTotalBytes;
+}
+
+QString ResponseCache::diskFileName(const QString& key) {
+    return QString::fromLatin1(QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Sha1).toHex()) + ".jpg";
+}
+
+// File I/O runs without the mutex; only the index is updated under it.
+bool ResponseCache::readDisk(const QString& key, QByteArray& data) {
+    const QString name = diskFileName(key);
+    QString path;
+    {
+        QMutexLocker locker(&mutex);
+        if (diskDirectory.isEmpty() || !diskEntries.contains(name)) {
+            return false;
+        }
+        touchDisk(name);
+        path = QDir(diskDirectory).filePath(name);
+    }
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    data = file.readAll();
+    return !data.isEmpty();
+}
+
+void ResponseCache::writeDisk(const QString& key, const QByteArray& data) {
+    const QString name = diskFileName(key);
+    QString path;
+    {
+        QMutexLocker locker(&mutex);
+        if (diskDirectory.isEmpty() || data.size() > diskMaxBytes || diskEntries.contains(name)) {
+            return;
+        }
+        path = QDir(diskDirectory).filePath(name);
+    }
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size() || !file.commit()) {
+        qWarning() << "Cannot write cache file" << path << file.errorString();
+        return;
+    }
+
+    QMutexLocker locker(&mutex);
+    if (diskEntries.contains(name)) {
+        return;
+    }
+    const DiskEntry entry = { data.size(), ++useCounter };
+    diskEntries.insert(name, entry);
+    diskOrder.insert(entry.lastUse, name);
+    diskTotalBytes += entry.size;
+    trimDisk();
+}
+
+void ResponseCache::touchDisk(const QString& name) {
+    DiskEntry& entry = diskEntries[name];
+    diskOrder.remove(entry.lastUse);
+    entry.lastUse = ++useCounter;
+    diskOrder.insert(entry.lastUse, name);
+}
+
+void ResponseCache::trimDisk() {
+    while (diskTotalBytes > diskMaxBytes && !diskOrder.isEmpty()) {
+        const QString name = diskOrder.first();
+        diskOrder.erase(diskOrder.begin());
+        diskTotalBytes -= diskEntries.take(name).size;
+        QFile::remove(QDir(diskDirectory).filePath(name));
+    }
+}
+
+qint64 ResponseCache::totalBytes() const {
+    QMutexLocker locker(&mutex);
+    return cache.totalCost();
+}
+
+int ResponseCache::count() const {
+    QMutexLocker locker(&mutex);
+    return cache.count();
+}
+
+quint64 ResponseCache::hits() const {
+    QMutexLocker locker(&mutex);
+    return hitCount;
+}
+
+quint64 ResponseCache::misses() const {
+    QMutexLocker locker(&mutex);
+    return missCount;
+}
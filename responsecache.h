@@ -0,0 +1,64 @@
+#ifndef RESPONSECACHE_H
+#define RESPONSECACHE_H
+
+#include <QByteArray>
+#include <QCache>
+#include <QHash>
+#include <QMap>
+#include <QMutex>
+#include <QString>
+#include <QtGlobal>
+
+// Cache of encoded GET response bodies. The key includes file size and
+// mtime, so a file replaced on disk simply misses and the old entry ages out.
+// An optional disk tier keeps a larger LRU set of bodies in a directory:
+// inserts are written through, and disk hits are promoted back to memory.
+// All methods are thread-safe.
+class ResponseCache {
+public:
+    explicit ResponseCache(qint64 maxBytes = 64 * 1024 * 1024);
+
+    static QString makeKey(const QString& path, const QString& strategyName);
+
+    bool lookup(const QString& key, QByteArray& data);
+    void insert(const QString& key, const QByteArray& data);
+    void clear();
+
+    void setMaxBytes(qint64 maxBytes);
+    qint64 maxBytes() const;
+    // Entries already in the directory are adopted, oldest first, so the
+    // directory must be private: one owned by another user or writable by
+    // group or others is refused. maxBytes <= 0 or an empty directory
+    // disables the disk tier.
+    void setDiskCache(const QString& directory, qint64 maxBytes);
+    qint64 diskBytes() const;
+    qint64 totalBytes() const;
+    int count() const;
+    quint64 hits() const;
+    quint64 misses() const;
+
+private:
+    struct DiskEntry {
+        qint64 size;
+        quint64 lastUse;
+    };
+
+    static QString diskFileName(const QString& key);
+    bool readDisk(const QString& key, QByteArray& data);
+    void writeDisk(const QString& key, const QByteArray& data);
+    void touchDisk(const QString& name);
+    void trimDisk();
+
+    mutable QMutex mutex;
+    QCache<QString, QByteArray> cache;
+    quint64 hitCount;
+    quint64 missCount;
+    QString diskDirectory;
+    qint64 diskMaxBytes;
+    qint64 diskTotalBytes;
+    quint64 useCounter;
+    QHash<QString, DiskEntry> diskEntries;
+    QMap<quint64, QString> diskOrder;
+};
+
+#endif // RESPONSECACHE_H
@@ -0,0 +1,88 @@
+#include "scanpyramid.h"
+
+ScanPyramid::ScanPyramid(QObject* parent)
+    : QObject(parent), bufferedPixels(0), delivered(0), running(false) {}
+
+ScanPyramid::~ScanPyramid() {
+    cancel();
+}
+
+int ScanPyramid::start() {
+    cancel();
+    running = true;
+    return generation.loadAcquire();
+}
+
+void ScanPyramid::cancel() {
+    generation.fetchAndAddOrdered(1);
+    scans.clear();
+    delivered = 0;
+    running = false;
+    // Wakes a run waiting for room; it sees the new generation and stops.
+    QMutexLocker locker(&bufferMutex);
+    bufferedPixels = 0;
+    bufferReleased.wakeAll();
+}
+
+QImage ScanPyramid::takeScan(int index) {
+    const QImage image = scans.value(index);
+    qint64 freed = 0;
+    while (!scans.isEmpty() && scans.firstKey() <= index) {
+        const QImage dropped = scans.take(scans.firstKey());
+        freed += qint64(dropped.width()) * dropped.height();
+    }
+    release(freed);
+    return image;
+}
+
+bool ScanPyramid::addScan(int run, const QImage& image) {
+    if (!reserve(run, qint64(image.width()) * image.height())) {
+        return false;
+    }
+    QMetaObject::invokeMethod(this, [this, run, image] { deliverScan(run, image); }, Qt::QueuedConnection);
+    return true;
+}
+
+void ScanPyramid::finish(int run) {
+    QMetaObject::invokeMethod(this, [this, run] { deliverFinished(run); }, Qt::QueuedConnection);
+}
+
+// Blocks the producing thread until the scan fits into the buffer; a scan
+// larger than the whole budget still goes through once the buffer is empty.
+bool ScanPyramid::reserve(int run, qint64 pixels) {
+    QMutexLocker locker(&bufferMutex);
+    while (generation.loadAcquire() == run && bufferedPixels > 0 && bufferedPixels + pixels > MaxBufferedPixels) {
+        bufferReleased.wait(&bufferMutex);
+    }
+    if (generation.loadAcquire() != run) {
+        return false;
+    }
+    bufferedPixels += pixels;
+    return true;
+}
+
+void ScanPyramid::release(qint64 pixels) {
+    if (pixels == 0) {
+        return;
+    }
+    QMutexLocker locker(&bufferMutex);
+    bufferedPixels = qMax<qint64>(0, bufferedPixels - pixels);
+    bufferReleased.wakeAll();
+}
+
+void ScanPyramid::deliverScan(int run, const QImage& image) {
+    if (run != generation.loadAcquire()) {
+        return;
+    }
+    scans.insert(delivered, image);
+    ++delivered;
+    emit scanReady(delivered - 1, image);
+}
+
+void ScanPyramid::deliverFinished(int run) {
+    if (run != generation.loadAcquire()) {
+        return;
+    }
+    running = false;
+    emit finished(delivered);
+}
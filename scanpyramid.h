@@ -0,0 +1,61 @@
+#ifndef SCANPYRAMID_H
+#define SCANPYRAMID_H
+
+#include <QObject>
+#include <QAtomicInt>
+#include <QImage>
+#include <QMap>
+#include <QMutex>
+#include <QWaitCondition>
+
+// The scans of the image being viewed, coarsest first, added by a producer
+// thread as they are decoded (AsyncImageLoader feeds it from the decode
+// that produced the first image, so the file is decoded once). Every scan
+// is a full-resolution image (a 24 MP file is ~72 MB per scan), so only
+// scans not taken yet are kept, up to MaxBufferedPixels: addScan() blocks
+// the producer until takeScan() makes room. Scans are announced on the
+// owner's thread as they arrive. start() or cancel() discards whatever the
+// previous run still adds.
+class ScanPyramid : public QObject {
+    Q_OBJECT
+public:
+    explicit ScanPyramid(QObject* parent = nullptr);
+    ~ScanPyramid();
+
+    // Begins a new run; its id goes with every addScan() and finish().
+    int start();
+    void cancel();
+
+    // Producer side, callable from any thread. addScan() returns false once
+    // the run is cancelled or superseded; the producer should then stop.
+    bool addScan(int run, const QImage& image);
+    void finish(int run);
+
+    bool isRunning() const { return running; }
+    // Scans received so far, including the ones already taken.
+    int count() const { return delivered; }
+    // Returns the scan and drops it together with every earlier one.
+    QImage takeScan(int index);
+
+    static const qint64 MaxBufferedPixels = 64 * 1024 * 1024;
+
+signals:
+    void scanReady(int index, const QImage& image);
+    void finished(int count);
+
+private:
+    bool reserve(int run, qint64 pixels);
+    void release(qint64 pixels);
+    void deliverScan(int run, const QImage& image);
+    void deliverFinished(int run);
+
+    QAtomicInt generation;
+    QMutex bufferMutex;
+    QWaitCondition bufferReleased;
+    qint64 bufferedPixels;
+    QMap<int, QImage> scans;
+    int delivered;
+    bool running;
+};
+
+#endif // SCANPYRAMID_H
@@ -0,0 +1,177 @@
+#include "servermetrics.h"
+#include "responsecache.h"
+
+const int ServerMetrics::StatusCodes[StatusCount - 1] = { 200, 206, 400, 404, 413, 415, 416, 431, 500, 503 };
+
+const qint64 ServerMetrics::BucketBoundsUs[BucketCount] = {
+    100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000, 2500000
+};
+
+namespace {
+
+const char* const MethodNames[ServerMetrics::MethodCount] = { "GET", "POST", "other" };
+const char* const StageNames[ServerMetrics::StageCount] = { "parse", "decode", "encode", "write", "tls_handshake" };
+
+void add(std::atomic<quint64>& counter, quint64 value) {
+    counter.fetch_add(value, std::memory_order_relaxed);
+}
+
+QByteArray seconds(double value) {
+    return QByteArray::number(value, 'g', 9);
+}
+
+}
+
+ServerMetrics::ServerMetrics()
+    : shards(new Shard[MaxShards]()) {}
+
+ServerMetrics::~ServerMetrics() {
+    delete[] shards;
+}
+
+ServerMetrics::Method ServerMetrics::method(QByteArrayView name) {
+    if (name == QByteArrayView("GET")) {
+        return Get;
+    }
+    if (name == QByteArrayView("POST")) {
+        return Post;
+    }
+    return OtherMethod;
+}
+
+void ServerMetrics::countResponse(int worker, Method method, const QByteArray& statusLine) {
+    const int code = statusLine.left(3).toInt();
+    int slot = StatusCount - 1;
+    for (int i = 0; i < StatusCount - 1; ++i) {
+        if (StatusCodes[i] == code) {
+            slot = i;
+            break;
+        }
+    }
+    add(shard(worker).responses[method][slot], 1);
+}
+
+void ServerMetrics::observe(int worker, Stage stage, qint64 nsecs) {
+    const qint64 us = nsecs / 1000;
+    int bucket = 0;
+    while (bucket < BucketCount && us > BucketBoundsUs[bucket]) {
+        ++bucket;
+    }
+    Shard& s = shard(worker);
+    add(s.buckets[stage][bucket], 1);
+    add(s.stageNsecs[stage], quint64(qMax<qint64>(0, nsecs)));
+}
+
+void ServerMetrics::addBytesIn(int worker, qint64 bytes) {
+    add(shard(worker).bytesIn, quint64(bytes));
+}
+
+void ServerMetrics::addBytesOut(int worker, qint64 bytes) {
+    add(shard(worker).bytesOut, quint64(bytes));
+}
+
+void ServerMetrics::connectionOpened(int worker) {
+    add(shard(worker).opened, 1);
+}
+
+void ServerMetrics::connectionClosed(int worker) {
+    add(shard(worker).closed, 1);
+}
+
+quint64 ServerMetrics::sum(std::atomic<quint64> Shard::*counter) const {
+    quint64 total = 0;
+    for (int i = 0; i < MaxShards; ++i) {
+        total += (shards[i].*counter).load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+void ServerMetrics::appendHistogram(QByteArray& out, const QByteArray& name, const QByteArray& labels,
+                                    Stage stage) const {
+    const QByteArray prefix = labels.isEmpty() ? QByteArray("{") : "{" + labels + ",";
+    quint64 cumulative = 0;
+    quint64 nsecs = 0;
+    for (int bucket = 0; bucket <= BucketCount; ++bucket) {
+        for (int i = 0; i < MaxShards; ++i) {
+            cumulative += shards[i].buckets[stage][bucket].load(std::memory_order_relaxed);
+        }
+        const QByteArray le = bucket < BucketCount ? seconds(BucketBoundsUs[bucket] / 1e6) : QByteArray("+Inf");
+        out += name + "_bucket" + prefix + "le=\"" + le + "\"} " + QByteArray::number(cumulative) + '\n';
+    }
+    for (int i = 0; i < MaxShards; ++i) {
+        nsecs += shards[i].stageNsecs[stage].load(std::memory_order_relaxed);
+    }
+    const QByteArray labelSet = labels.isEmpty() ? QByteArray() : "{" + labels + "}";
+    out += name + "_sum" + labelSet + ' ' + seconds(nsecs / 1e9) + '\n';
+    out += name + "_count" + labelSet + ' ' + QByteArray::number(cumulative) + '\n';
+}
+
+QByteArray ServerMetrics::render(const ResponseCache& responses, const ResponseCache& variants) const {
+    QByteArray out;
+    out += "# HELP jpeg_responses_total Responses sent, by request method and status code.\n"
+           "# TYPE jpeg_responses_total counter\n";
+    for (int method = 0; method < MethodCount; ++method) {
+        for (int slot = 0; slot < StatusCount; ++slot) {
+            quint64 count = 0;
+            for (int i = 0; i < MaxShards; ++i) {
+                count += shards[i].responses[method][slot].load(std::memory_order_relaxed);
+            }
+            if (count == 0) {
+                continue;
+            }
+            const QByteArray code = slot < StatusCount - 1 ? QByteArray::number(StatusCodes[slot]) : QByteArray("other");
+            out += QByteArray("jpeg_responses_total{method=\"") + MethodNames[method] + "\",code=\"" + code + "\"} "
+                 + QByteArray::number(count) + '\n';
+        }
+    }
+
+    out += "# HELP jpeg_stage_duration_seconds Time per request stage.\n"
+           "# TYPE jpeg_stage_duration_seconds histogram\n";
+    for (int stage = Parse; stage <= Write; ++stage) {
+        appendHistogram(out, "jpeg_stage_duration_seconds", QByteArray("stage=\"") + StageNames[stage] + '"',
+                        Stage(stage));
+    }
+    out += "# HELP jpeg_tls_handshake_seconds Duration of completed TLS handshakes.\n"
+           "# TYPE jpeg_tls_handshake_seconds histogram\n";
+    appendHistogram(out, "jpeg_tls_handshake_seconds", QByteArray(), TlsHandshake);
+
+    const quint64 opened = sum(&Shard::opened);
+    const quint64 closed = sum(&Shard::closed);
+    out += "# HELP jpeg_received_bytes_total Bytes read from clients.\n"
+           "# TYPE jpeg_received_bytes_total counter\n"
+           "jpeg_received_bytes_total " + QByteArray::number(sum(&Shard::bytesIn)) + "\n"
+           "# HELP jpeg_sent_bytes_total Bytes written to clients.\n"
+           "# TYPE jpeg_sent_bytes_total counter\n"
+           "jpeg_sent_bytes_total " + QByteArray::number(sum(&Shard::bytesOut)) + "\n"
+           "# HELP jpeg_connections_total Connections accepted.\n"
+           "# TYPE jpeg_connections_total counter\n"
+           "jpeg_connections_total " + QByteArray::number(opened) + "\n"
+           "# HELP jpeg_active_connections Connections currently open.\n"
+           "# TYPE jpeg_active_connections gauge\n"
+           "jpeg_active_connections " + QByteArray::number(opened >= closed ? opened - closed : 0) + "\n";
+
+    // The caches count under their own lock; reading them here is off the hot path.
+    const struct { const char* name; const ResponseCache& cache; } caches[] = {
+        { "response", responses }, { "variant", variants }
+    };
+    QByteArray hits = "# HELP jpeg_cache_hits_total Encoded response cache hits.\n"
+                      "# TYPE jpeg_cache_hits_total counter\n";
+    QByteArray misses = "# HELP jpeg_cache_misses_total Encoded response cache misses.\n"
+                        "# TYPE jpeg_cache_misses_total counter\n";
+    QByteArray ratio = "# HELP jpeg_cache_hit_ratio Hits over lookups since start.\n"
+                       "# TYPE jpeg_cache_hit_ratio gauge\n";
+    QByteArray bytes = "# HELP jpeg_cache_bytes Bytes held in memory by the cache.\n"
+                       "# TYPE jpeg_cache_bytes gauge\n";
+    for (const auto& entry : caches) {
+        const QByteArray label = QByteArray("{cache=\"") + entry.name + "\"} ";
+        const quint64 cacheHits = entry.cache.hits();
+        const quint64 cacheMisses = entry.cache.misses();
+        const quint64 lookups = cacheHits + cacheMisses;
+        hits += "jpeg_cache_hits_total" + label + QByteArray::number(cacheHits) + '\n';
+        misses += "jpeg_cache_misses_total" + label + QByteArray::number(cacheMisses) + '\n';
+        ratio += "jpeg_cache_hit_ratio" + label + QByteArray::number(lookups ? double(cacheHits) / lookups : 0.0) + '\n';
+        bytes += "jpeg_cache_bytes" + label + QByteArray::number(entry.cache.totalBytes()) + '\n';
+    }
+    out += hits + misses + ratio + bytes;
+    return out;
+}
@@ -0,0 +1,66 @@
+#ifndef SERVERMETRICS_H
+#define SERVERMETRICS_H
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QtGlobal>
+#include <atomic>
+
+class ResponseCache;
+
+// Server counters, rendered in the Prometheus text format for GET /metrics.
+// Each worker thread (-1 is the main thread) records into its own
+// cache-line aligned shard with relaxed atomic adds, so the hot path never
+// locks or shares a cache line with another thread; render() sums the
+// shards when the endpoint is scraped.
+class ServerMetrics {
+public:
+    enum Method { Get, Post, OtherMethod, MethodCount };
+    enum Stage { Parse, Decode, Encode, Write, TlsHandshake, StageCount };
+
+    ServerMetrics();
+    ~ServerMetrics();
+
+    static Method method(QByteArrayView name);
+
+    // statusLine starts with the code, e.g. "206 Partial Content".
+    void countResponse(int worker, Method method, const QByteArray& statusLine);
+    void observe(int worker, Stage stage, qint64 nsecs);
+    void addBytesIn(int worker, qint64 bytes);
+    void addBytesOut(int worker, qint64 bytes);
+    void connectionOpened(int worker);
+    void connectionClosed(int worker);
+
+    QByteArray render(const ResponseCache& responses, const ResponseCache& variants) const;
+
+private:
+    // Workers beyond this share shards, which stays correct, only slower.
+    static const int MaxShards = 64;
+    static const int StatusCount = 11;
+    static const int BucketCount = 14;
+    // The last status slot collects codes not listed here.
+    static const int StatusCodes[StatusCount - 1];
+    // Upper bounds in microseconds; the +Inf bucket follows them.
+    static const qint64 BucketBoundsUs[BucketCount];
+
+    struct alignas(64) Shard {
+        std::atomic<quint64> responses[MethodCount][StatusCount];
+        std::atomic<quint64> buckets[StageCount][BucketCount + 1];
+        std::atomic<quint64> stageNsecs[StageCount];
+        std::atomic<quint64> bytesIn;
+        std::atomic<quint64> bytesOut;
+        std::atomic<quint64> opened;
+        std::atomic<quint64> closed;
+    };
+
+    Shard& shard(int worker) { return shards[(worker + 1) % MaxShards]; }
+    quint64 sum(std::atomic<quint64> Shard::*counter) const;
+    void appendHistogram(QByteArray& out, const QByteArray& name, const QByteArray& labels, Stage stage) const;
+
+    Shard* shards;
+
+    ServerMetrics(const ServerMetrics&) = delete;
+    ServerMetrics& operator=(const ServerMetrics&) = delete;
+};
+
+#endif // SERVERMETRICS_H
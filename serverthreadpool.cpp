@@ -0,0 +1,73 @@
+#include "serverthreadpool.h"
+#include <QThread>
+#include <QDebug>
+
+ServerThreadPool::ServerThreadPool(QObject* parent)
+    : QObject(parent), nextWorker(0) {}
+
+ServerThreadPool::~ServerThreadPool() {
+    stop();
+}
+
+void ServerThreadPool::start(int threadCount) {
+    stop();
+    for (int i = 0; i < threadCount; ++i) {
+        Worker* worker = new Worker;
+        worker->thread = new QThread();
+        worker->thread->setObjectName(QString("jpeg-worker-%1").arg(i));
+        worker->context = new QObject();
+        worker->context->moveToThread(worker->thread);
+        worker->load.storeRelaxed(0);
+        worker->thread->start();
+        workers.append(worker);
+    }
+    qDebug() << "Started" << threadCount << "worker threads";
+}
+
+void ServerThreadPool::stop() {
+    for (Worker* worker : workers) {
+        worker->thread->quit();
+        worker->thread->wait();
+        delete worker->context;
+        delete worker->thread;
+        delete worker;
+    }
+    workers.clear();
+    nextWorker = 0;
+}
+
+int ServerThreadPool::load(int index) const {
+    if (index < 0 || index >= workers.size()) {
+        return 0;
+    }
+    return workers[index]->load.loadRelaxed();
+}
+
+void ServerThreadPool::dispatch(const std::function<void(int)>& task) {
+    if (workers.isEmpty()) {
+        task(-1);
+        return;
+    }
+
+    // Least-loaded worker; the rotating start index breaks ties round-robin.
+    const int count = workers.size();
+    int best = nextWorker % count;
+    for (int i = 1; i < count; ++i) {
+        const int candidate = (nextWorker + i) % count;
+        if (workers[candidate]->load.loadRelaxed() < workers[best]->load.loadRelaxed()) {
+            best = candidate;
+        }
+    }
+    nextWorker = (best + 1) % count;
+
+    workers[best]->load.ref();
+    QMetaObject::invokeMethod(workers[best]->context, [task, best]() {
+        task(best);
+    }, Qt::QueuedConnection);
+}
+
+void ServerThreadPool::release(int index) {
+    if (index >= 0 && index < workers.size()) {
+        workers[index]->load.deref();
+    }
+}
@@ -0,0 +1,39 @@
+#ifndef SERVERTHREADPOOL_H
+#define SERVERTHREADPOOL_H
+
+#include <QObject>
+#include <QVector>
+#include <QAtomicInt>
+#include <functional>
+
+class QThread;
+
+// Fixed set of worker threads, each running its own event loop. Tasks are
+// queued to the least-loaded worker; "load" is the number of tasks that have
+// not been released yet (for the servers: open connections).
+class ServerThreadPool : public QObject {
+    Q_OBJECT
+public:
+    explicit ServerThreadPool(QObject* parent = nullptr);
+    ~ServerThreadPool();
+
+    void start(int threadCount);
+    void stop();
+    int threadCount() const { return workers.size(); }
+    int load(int index) const;
+
+    // Runs task(index) on the chosen worker's thread.
+    void dispatch(const std::function<void(int)>& task);
+    void release(int index);
+
+private:
+    struct Worker {
+        QThread* thread;
+        QObject* context;
+        QAtomicInt load;
+    };
+    QVector<Worker*> workers;
+    int nextWorker;
+};
+
+#endif // SERVERTHREADPOOL_H